@@ -2,7 +2,23 @@
 
 
 #include "InteractiveSnowComponent.h"
+#include "Async/Async.h"
+#include "Engine/Canvas.h"
+#include "Engine/Texture2D.h"
 #include "Kismet/KismetRenderingLibrary.h"
+#include "Materials/MaterialInterface.h"
+#include "Misc/Compression.h"
+#include "RenderingThread.h"
+#include "RHICommandList.h"
+#include "SnowDepthPyramid.h"
+#include "SnowStampLog.h"
+#include "SnowTexelMath.h"
+#include "SnowWorldSubsystem.h"
+#include "TextureResource.h"
+
+#if WITH_EDITOR
+#include "Editor.h"
+#endif
 
 
 const FName LOCATION_PARAMETER_NAME = "UV Location";
@@ -12,6 +28,9 @@ const FName ROTATION_PARAMETER_NAME = "Rotation";
 const FName PREV_OFFSET_X_PARAMETER_NAME = "Previous Texture Offset X";
 const FName PREV_OFFSET_Y_PARAMETER_NAME = "Previous Texture Offset Y";
 const FName RENDER_TARGET_PARAMETER_NAME = "Displacement Map";
+const FName WRAP_OFFSET_PARAMETER_NAME = "Wrap Offset";
+const FName TEXTURE_TO_COPY_PARAMETER_NAME = "TextureToCopy";
+const FName PREVIOUS_RENDER_TEXTURE_PARAMETER_NAME = "PreviousRenderTexture";
 
 const FString NAME_SEPARATOR = TEXT("_");
 const FString WARNING_HEADER = TEXT("WARNING :: [Interactive Snow Component] ::");
@@ -19,10 +38,81 @@ const FString WARNING_HEADER = TEXT("WARNING :: [Interactive Snow Component] ::"
 const TCHAR* DEFAULT_DRAW_MATERIAL = TEXT("Material'/Game/Materials/RenderTargetDrawing/M_DepthPainter.M_DepthPainter'");
 const TCHAR* DEFAULT_COPY_MATERIAL = TEXT("Material'/Game/Materials/RenderTargetDrawing/M_TextureCopy.M_TextureCopy'");
 
+const FString BAKED_DISPLACEMENT_DIRECTORY = TEXT("/Game/Textures/BakedSnow/");
+
+constexpr float VISIBILITY_TOLERANCE = 0.2f; // Seconds since the last render for a surface to count as visible, on top of the time since the last check
+
+
+// Splits a surface texel area into pieces that don't cross the edges of a ring buffer of the given resolution
+static void SplitToroidalArea(const FIntRect& TexelRect, int32 Resolution, TArray<FIntRect>& OutPieces)
+{
+	for (int32 minY = TexelRect.Min.Y; minY < TexelRect.Max.Y;)
+	{
+		int32 maxY = FMath::Min((SnowTexelMath::FloorDivide(minY, Resolution) + 1) * Resolution, TexelRect.Max.Y);
+
+		for (int32 minX = TexelRect.Min.X; minX < TexelRect.Max.X;)
+		{
+			int32 maxX = FMath::Min((SnowTexelMath::FloorDivide(minX, Resolution) + 1) * Resolution, TexelRect.Max.X);
+			OutPieces.Add(FIntRect(minX, minY, maxX, maxY));
+
+			minX = maxX;
+		}
+
+		minY = maxY;
+	}
+}
+
+// Returns the surface texel offset of the ring buffer repetition that contains the given texel
+static FIntPoint GetToroidalWrap(FIntPoint Texel, int32 Resolution)
+{
+	return FIntPoint(SnowTexelMath::FloorDivide(Texel.X, Resolution) * Resolution, SnowTexelMath::FloorDivide(Texel.Y, Resolution) * Resolution);
+}
+
+// Returns whether the given material (or its parents) exposes a vector parameter with the given name
+static bool HasMaterialVectorParameter(const UMaterialInterface* Material, FName ParameterName)
+{
+	if (!Material)
+	{
+		return false;
+	}
+
+	TArray<FMaterialParameterInfo> parameterInfos;
+	TArray<FGuid> parameterIds;
+	Material->GetAllVectorParameterInfo(parameterInfos, parameterIds);
+
+	return parameterInfos.ContainsByPredicate([ParameterName](const FMaterialParameterInfo& Info) { return Info.Name == ParameterName; });
+}
+
+// Keeps only the R channel of a displacement readback (half floats) and compresses it with zlib
+static bool CompressDisplacement(const TArray<FFloat16Color>& Pixels, TArray<uint8>& OutCompressedData)
+{
+	TArray<FFloat16> depth;
+	depth.SetNumUninitialized(Pixels.Num());
+
+	for (int32 i = 0; i < Pixels.Num(); ++i)
+	{
+		depth[i] = Pixels[i].R;
+	}
+
+	int32 uncompressedSize = depth.Num() * sizeof(FFloat16);
+	int32 compressedSize = FCompression::CompressMemoryBound(NAME_Zlib, uncompressedSize);
+	OutCompressedData.SetNumUninitialized(compressedSize);
+
+	if (!FCompression::CompressMemory(NAME_Zlib, OutCompressedData.GetData(), compressedSize, depth.GetData(), uncompressedSize))
+	{
+		OutCompressedData.Empty();
+		return false;
+	}
+
+	OutCompressedData.SetNum(compressedSize);
+	return true;
+}
+
 
 UInteractiveSnowComponent::UInteractiveSnowComponent(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
-	PrimaryComponentTick.bCanEverTick = false;
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false; // Only enabled when there is per-frame work to do (e.g. depth pyramid updates)
 
 	static ConstructorHelpers::FObjectFinder<UMaterialInterface> defaultDrawMaterial(DEFAULT_DRAW_MATERIAL);
 	static ConstructorHelpers::FObjectFinder<UMaterialInterface> defaultCopyMaterial(DEFAULT_COPY_MATERIAL);
@@ -38,16 +128,45 @@ UInteractiveSnowComponent::UInteractiveSnowComponent(const FObjectInitializer& O
 	}
 }
 
+void UInteractiveSnowComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// Downsample only the tiles that were drawn to since the last frame
+
+	if (DepthPyramid)
+	{
+		DepthPyramid->Update();
+	}
+}
+
 void UInteractiveSnowComponent::DrawMaterial(FVector2D UVs, UTexture2D* ShapeTexture, FVector2D TextureScale, float TextureRotation, bool bIsMainPlayer)
 {
 	// General setup and checks
 
+	if (!bSurfaceInitialized && HasBegunPlay())
+	{
+		InitSurface(); // Can't wait for time-sliced initialization
+	}
+
+	LastActiveTime = GetWorld()->GetTimeSeconds();
+
+	if (HibernationState != ESnowSurfaceHibernation::Awake)
+	{
+		WakeUp(); // Cancels a pending hibernation, or restores the render targets
+	}
+
 	if (!RenderTarget || !DrawMaterialInstance)
 	{
 		LogWarning("Either render target or the draw material instance is null. Unable to draw material on render target.");
 		return;
 	}
 
+	if (bRecordStamps)
+	{
+		GetWorld()->GetSubsystem<USnowWorldSubsystem>()->RecordStamp(this, UVs, ShapeTexture, TextureScale, TextureRotation, bIsMainPlayer);
+	}
+
 	if (CurrentShapeTexture != ShapeTexture)
 	{
 		DrawMaterialInstance->SetTextureParameterValue("Shape Texture", ShapeTexture);
@@ -63,6 +182,7 @@ void UInteractiveSnowComponent::DrawMaterial(FVector2D UVs, UTexture2D* ShapeTex
 	if (!bInfiniteSurface)
 	{
 		DrawMaterialInstance->SetVectorParameterValue(LOCATION_PARAMETER_NAME, FLinearColor(UVs.X, UVs.Y, 0.f, 1.f));
+		MarkDepthPyramidDirty(UVs, drawMaterialScale);
 	}
 	else
 	{
@@ -70,7 +190,17 @@ void UInteractiveSnowComponent::DrawMaterial(FVector2D UVs, UTexture2D* ShapeTex
 
 		drawMaterialScale *= 1.f / DisplacementTextureScale;
 
-		if (bIsMainPlayer)
+		if (bToroidalAddressing)
+		{
+			// The render target is a ring buffer addressed by surface texel, so the cached texture never moves.
+			/// Only the window origin moves (in whole texels), and the texels it exposes are cleared. Stamps are drawn in DrawToroidalStamp.
+
+			if (bIsMainPlayer)
+			{
+				MoveToroidalWindow(UVs);
+			}
+		}
+		else if (bIsMainPlayer)
 		{
 			// Scale render target texture to an area around the object/player (already calculated during BeginPlay).
 
@@ -89,6 +219,15 @@ void UInteractiveSnowComponent::DrawMaterial(FVector2D UVs, UTexture2D* ShapeTex
 			DrawMaterialInstance->SetScalarParameterValue(PREV_OFFSET_Y_PARAMETER_NAME, distMoved.Y);
 
 			PrevUvLocation = discreteUVs;
+
+			// Moving the cached texture changes every texel. The pyramid only rebuilds on its next readback, no matter how many moves happen meanwhile.
+			/// Toroidal addressing avoids this, only the exposed texels are dirtied.
+			if (DepthPyramid && !distMoved.IsZero())
+			{
+				DepthPyramid->MarkAllDirty();
+			}
+
+			MarkDepthPyramidDirty(FVector2D(0.5f, 0.5f), drawMaterialScale);
 		}
 		else
 		{
@@ -103,6 +242,8 @@ void UInteractiveSnowComponent::DrawMaterial(FVector2D UVs, UTexture2D* ShapeTex
 			// Force these to 0 always to prevent moving the texture when the main object is not moving
 			DrawMaterialInstance->SetScalarParameterValue(PREV_OFFSET_X_PARAMETER_NAME, 0.f);
 			DrawMaterialInstance->SetScalarParameterValue(PREV_OFFSET_Y_PARAMETER_NAME, 0.f);
+
+			MarkDepthPyramidDirty(uvLocation, drawMaterialScale);
 		}
 	}
 
@@ -114,20 +255,139 @@ void UInteractiveSnowComponent::DrawMaterial(FVector2D UVs, UTexture2D* ShapeTex
 
 	// Draw on render targets
 
+	if (bInfiniteSurface && bToroidalAddressing)
+	{
+		DrawToroidalStamp(UVs, drawMaterialScale); // Only draws the texels covered by the shape
+		return;
+	}
+
 	UKismetRenderingLibrary::DrawMaterialToRenderTarget(GetWorld(), RenderTarget, DrawMaterialInstance); // Actual render target
 	UKismetRenderingLibrary::DrawMaterialToRenderTarget(GetWorld(), PrevRenderTarget, TextureCopyMaterialInstance); // Cached render target
 }
 
+void UInteractiveSnowComponent::SubmitStamp(FVector2D UVs, UTexture2D* ShapeTexture, FVector2D TextureScale, float TextureRotation, bool bIsMainPlayer)
+{
+	if (!bAcceptingStamps)
+	{
+		return;
+	}
+
+	FSnowSubmittedStamp stamp;
+	stamp.UVs = UVs;
+	stamp.ShapeTexture = ShapeTexture;
+	stamp.TextureScale = TextureScale;
+	stamp.TextureRotation = TextureRotation;
+	stamp.bIsMainPlayer = bIsMainPlayer;
+
+	SubmittedStamps.Enqueue(stamp);
+	NumSubmittedStamps.Increment();
+
+	// Only the first submission since the last drain queues the surface. The flag is set after enqueuing,
+	/// so a stamp is either drained by the current drain or queues the surface again.
+
+	USnowWorldSubsystem* drainSubsystem = StampDrainSubsystem.Load();
+
+	if (drainSubsystem && !bSubmittedStampsQueued.AtomicSet(true))
+	{
+		drainSubsystem->QueueSubmittedStamps(this);
+	}
+}
+
+void UInteractiveSnowComponent::DrawSubmittedStamps()
+{
+	check(IsInGameThread());
+
+	bSubmittedStampsQueued = false; // Reset before draining so that stamps submitted meanwhile queue the surface again
+
+	// Submissions that raced with EndPlay can still queue the surface
+
+	if (!bAcceptingStamps)
+	{
+		SubmittedStamps.Empty();
+		return;
+	}
+
+	FSnowSubmittedStamp stamp;
+
+	while (SubmittedStamps.Dequeue(stamp))
+	{
+		DrawMaterial(stamp.UVs, stamp.ShapeTexture.Get(), stamp.TextureScale, stamp.TextureRotation, stamp.bIsMainPlayer);
+		++NumDrainedStamps;
+	}
+}
+
+int64 UInteractiveSnowComponent::GetNumSubmittedStamps() const
+{
+	return NumSubmittedStamps.GetValue();
+}
+
+int64 UInteractiveSnowComponent::GetNumDrainedStamps() const
+{
+	return NumDrainedStamps;
+}
+
 int32 UInteractiveSnowComponent::GetUsedUvChannel() const
 {
 	return UvChannel;
 }
 
+UStaticMeshComponent* UInteractiveSnowComponent::GetSurfaceMeshComponent() const
+{
+	return StaticMeshComponent;
+}
+
+void UInteractiveSnowComponent::GetStampLogSurface(FSnowStampLogSurface& OutSurface) const
+{
+	OutSurface.Name = OwnerActor ? OwnerActor->GetName() : GetName();
+	OutSurface.Resolution = RenderTargetResolution;
+	OutSurface.bInfiniteSurface = bInfiniteSurface;
+	OutSurface.DisplacementTextureScale = DisplacementTextureScale;
+	OutSurface.bToroidalAddressing = bToroidalAddressing;
+}
+
 void UInteractiveSnowComponent::BeginPlay()
 {
 	Super::BeginPlay();
 
 	OwnerActor = GetOwner(); // Need to delay this until BeginPlay so that it works when inherited by blueprints
+	StaticMeshComponent = Cast<UStaticMeshComponent>(OwnerActor->GetComponentByClass(UStaticMeshComponent::StaticClass()));
+
+	// Registered right away (not on init) so that interactors can find the surface and trigger its initialization
+
+	SnowSubsystem = GetWorld()->GetSubsystem<USnowWorldSubsystem>();
+	SnowSubsystem->RegisterSurface(this, StaticMeshComponent);
+
+	// Static surfaces never move, so this only costs something for movable ones
+
+	if (StaticMeshComponent)
+	{
+		StaticMeshComponent->TransformUpdated.AddUObject(this, &UInteractiveSnowComponent::OnSurfaceMoved);
+	}
+
+	if (bTimeSlicedInit)
+	{
+		SnowSubsystem->RequestSurfaceInit(this);
+	}
+	else
+	{
+		InitSurface();
+	}
+
+	// Stamps submitted before there was a subsystem to drain them
+
+	bAcceptingStamps = true;
+	StampDrainSubsystem.Store(SnowSubsystem);
+
+	if (!SubmittedStamps.IsEmpty() && !bSubmittedStampsQueued.AtomicSet(true))
+	{
+		SnowSubsystem->QueueSubmittedStamps(this);
+	}
+}
+
+void UInteractiveSnowComponent::InitSurface()
+{
+	bSurfaceInitialized = true;
+	LastActiveTime = GetWorld()->GetTimeSeconds();
 
 	RenderTarget = CreateRenderTarget(RenderTargetResolution, ETextureRenderTargetFormat::RTF_R16f);
 	PrevRenderTarget = CreateRenderTarget(RenderTargetResolution, ETextureRenderTargetFormat::RTF_R16f);
@@ -136,24 +396,478 @@ void UInteractiveSnowComponent::BeginPlay()
 
 	InitMaterials();
 
+	// Start from the authored trails instead of untouched snow
+
+	if (InitialDisplacement)
+	{
+		if (bInfiniteSurface)
+		{
+			LogWarning("Initial displacement is not supported on infinite surfaces. Ignoring it on: " + OwnerActor->GetName());
+		}
+		else
+		{
+			CopyTextureToRenderTargets(InitialDisplacement);
+		}
+	}
+
 	if (bInfiniteSurface)
 	{
 		DisplacementTextureScale = GetDisplacementTextureScale(InfiniteSurfaceRenderArea, bInfiniteSurface);
+
+		// The surface material can't read the ring buffer without the wrap offset, it would show the trails scrambled
+
+		if (bToroidalAddressing && !HasMaterialVectorParameter(DynamicMaterial, WRAP_OFFSET_PARAMETER_NAME))
+		{
+			LogWarning("Surface material has no \"" + WRAP_OFFSET_PARAMETER_NAME.ToString() + "\" parameter. Disabling toroidal addressing on: " + OwnerActor->GetName());
+			bToroidalAddressing = false;
+		}
+
+		if (bToroidalAddressing)
+		{
+			InitToroidalAddressing();
+		}
+	}
+
+	if (bEnableSnowPhysics)
+	{
+		InitDepthPyramid();
+	}
+}
+
+void UInteractiveSnowComponent::ReleaseRenderTargets()
+{
+	if (DepthPyramid)
+	{
+		DepthPyramid->Release();
+		DepthPyramid = nullptr;
+	}
+
+	SetComponentTickEnabled(false); // Nothing left to update
+
+	// Return render targets to the pool so that streaming surfaces in and out recycles them
+
+	if (SnowSubsystem)
+	{
+		SnowSubsystem->ReleaseRenderTarget(RenderTarget);
+		SnowSubsystem->ReleaseRenderTarget(PrevRenderTarget);
+	}
+
+	// Pooled render targets now belong to someone else, so no material may keep drawing from them
+
+	if (DynamicMaterial)
+	{
+		DynamicMaterial->SetTextureParameterValue(RENDER_TARGET_PARAMETER_NAME, nullptr);
+	}
+
+	if (DrawMaterialInstance)
+	{
+		DrawMaterialInstance->SetTextureParameterValue(PREVIOUS_RENDER_TEXTURE_PARAMETER_NAME, nullptr);
+	}
+
+	if (TextureCopyMaterialInstance)
+	{
+		TextureCopyMaterialInstance->SetTextureParameterValue(TEXTURE_TO_COPY_PARAMETER_NAME, nullptr);
+	}
+
+	RenderTarget = nullptr;
+	PrevRenderTarget = nullptr;
+	DrawMaterialInstance = nullptr;
+	TextureCopyMaterialInstance = nullptr;
+	CurrentShapeTexture = nullptr;
+}
+
+void UInteractiveSnowComponent::UpdateHibernation(float CurrentTime, bool bNearViewer)
+{
+	if (!bSurfaceInitialized)
+	{
+		return;
+	}
+
+	// Hibernating surfaces are still rendered (without displacement), so this also works for waking them up
+
+	float visibilityTolerance = FMath::Max(CurrentTime - LastVisibilityCheckTime, 0.f) + VISIBILITY_TOLERANCE;
+	LastVisibilityCheckTime = CurrentTime;
+
+	bool bVisible = bNearViewer || (StaticMeshComponent && StaticMeshComponent->WasRecentlyRendered(visibilityTolerance));
+
+	if (bVisible)
+	{
+		LastActiveTime = CurrentTime;
+	}
+
+	if (HibernationState == ESnowSurfaceHibernation::Hibernating)
+	{
+		if (bVisible)
+		{
+			WakeUp();
+		}
+	}
+	else if (HibernationState == ESnowSurfaceHibernation::ReadingBack)
+	{
+		if (bVisible)
+		{
+			CancelHibernation();
+		}
+		else if (!HibernationCompression.IsValid())
+		{
+			// Compressing takes a few milliseconds on large render targets, so it runs on a worker thread once the readback is done
+
+			if (HibernationFence.IsFenceComplete())
+			{
+				ReleaseHibernationReadbackTarget();
+
+				TSharedPtr<FHibernationReadback, ESPMode::ThreadSafe> readback = PendingHibernation;
+
+				HibernationCompression = Async(EAsyncExecution::ThreadPool, [readback]()
+				{
+					bool bCompressed = CompressDisplacement(readback->Data, readback->CompressedData);
+					readback->Data.Empty();
+
+					return bCompressed;
+				});
+			}
+		}
+		else if (HibernationCompression.IsReady())
+		{
+			if (HibernationCompression.Get())
+			{
+				FinishHibernation();
+			}
+			else
+			{
+				LogWarning("Unable to compress the displacement of: " + OwnerActor->GetName() + ". Hibernation cancelled.");
+				CancelHibernation();
+			}
+		}
+	}
+}
+
+bool UInteractiveSnowComponent::CanHibernate(float CurrentTime) const
+{
+	return bAllowHibernation && bSurfaceInitialized && HibernationState == ESnowSurfaceHibernation::Awake && RenderTarget
+		&& SubmittedStamps.IsEmpty() && CurrentTime - LastActiveTime >= HibernationDelay;
+}
+
+bool UInteractiveSnowComponent::BeginHibernation()
+{
+	if (HibernationState != ESnowSurfaceHibernation::Awake || !RenderTarget)
+	{
+		return false;
+	}
+
+	// Float readbacks only support RGBA16f surfaces
+
+	HibernationReadbackTarget = CopyDisplacementToFloatRGBA();
+	FTextureRenderTargetResource* resource = HibernationReadbackTarget->GameThread_GetRenderTargetResource();
+
+	if (!resource)
+	{
+		ReleaseHibernationReadbackTarget();
+		return false;
 	}
+
+	PendingHibernation = MakeShared<FHibernationReadback, ESPMode::ThreadSafe>();
+
+	TSharedPtr<FHibernationReadback, ESPMode::ThreadSafe> readback = PendingHibernation;
+	FIntRect rect = FIntRect(0, 0, HibernationReadbackTarget->SizeX, HibernationReadbackTarget->SizeY);
+
+	ENQUEUE_RENDER_COMMAND(SnowHibernationReadback)(
+		[resource, readback, rect](FRHICommandListImmediate& RHICmdList)
+		{
+			RHICmdList.ReadSurfaceFloatData(resource->GetRenderTargetTexture(), rect, readback->Data, CubeFace_PosX, 0, 0);
+		});
+
+	HibernationFence.BeginFence();
+	HibernationState = ESnowSurfaceHibernation::ReadingBack;
+
+	return true;
+}
+
+void UInteractiveSnowComponent::FinishHibernation()
+{
+	HibernatedDisplacement = MoveTemp(PendingHibernation->CompressedData);
+
+	PendingHibernation.Reset();
+	HibernationCompression = TFuture<bool>();
+
+	ReleaseRenderTargets();
+	HibernationState = ESnowSurfaceHibernation::Hibernating;
+
+	UE_LOG(LogTemp, Log, TEXT("Snow surface %s hibernated (%d KB compressed displacement)."), *OwnerActor->GetName(), HibernatedDisplacement.Num() / 1024);
+}
+
+void UInteractiveSnowComponent::CancelHibernation()
+{
+	// The render command and the compression task keep their own reference to the readback until they are done
+
+	PendingHibernation.Reset();
+	HibernationCompression = TFuture<bool>();
+
+	ReleaseHibernationReadbackTarget(); // Later pool users draw after the readback on the render thread
+
+	if (HibernationState == ESnowSurfaceHibernation::ReadingBack)
+	{
+		HibernationState = ESnowSurfaceHibernation::Awake;
+	}
+}
+
+void UInteractiveSnowComponent::ReleaseHibernationReadbackTarget()
+{
+	if (HibernationReadbackTarget && SnowSubsystem)
+	{
+		SnowSubsystem->ReleaseRenderTarget(HibernationReadbackTarget);
+	}
+
+	HibernationReadbackTarget = nullptr;
+}
+
+void UInteractiveSnowComponent::WakeUp()
+{
+	if (HibernationState == ESnowSurfaceHibernation::ReadingBack)
+	{
+		CancelHibernation(); // Render targets are still there
+		return;
+	}
+
+	if (HibernationState != ESnowSurfaceHibernation::Hibernating)
+	{
+		return;
+	}
+
+	HibernationState = ESnowSurfaceHibernation::Awake;
+
+	// Same resources as InitSurface. The surface material and the infinite surface state (window, cached texture location) were kept.
+
+	RenderTarget = CreateRenderTarget(RenderTargetResolution, ETextureRenderTargetFormat::RTF_R16f);
+	PrevRenderTarget = CreateRenderTarget(RenderTargetResolution, ETextureRenderTargetFormat::RTF_R16f);
+
+	InitRenderTargetMaterials();
+
+	if (DynamicMaterial)
+	{
+		DynamicMaterial->SetTextureParameterValue(RENDER_TARGET_PARAMETER_NAME, RenderTarget);
+	}
+
+	if (bInfiniteSurface && bToroidalAddressing)
+	{
+		InitToroidalRenderTargets(); // Recreates the resources, so it has to happen before restoring the displacement
+	}
+
+	// Upload the displacement to a transient texture and restore it with the same copy used for the initial displacement
+
+	int32 numTexels = RenderTargetResolution * RenderTargetResolution;
+	int32 uncompressedSize = numTexels * sizeof(FFloat16);
+
+	TArray<FFloat16> depth;
+	depth.SetNumUninitialized(numTexels);
+
+	if (FCompression::UncompressMemory(NAME_Zlib, depth.GetData(), uncompressedSize, HibernatedDisplacement.GetData(), HibernatedDisplacement.Num()))
+	{
+		UTexture2D* displacementTexture = UTexture2D::CreateTransient(RenderTargetResolution, RenderTargetResolution, EPixelFormat::PF_R16F);
+		displacementTexture->SRGB = false;
+		displacementTexture->Filter = TextureFilter::TF_Nearest;
+
+		void* mipData = displacementTexture->PlatformData->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
+		FMemory::Memcpy(mipData, depth.GetData(), uncompressedSize);
+		displacementTexture->PlatformData->Mips[0].BulkData.Unlock();
+
+		displacementTexture->UpdateResource();
+		CopyTextureToRenderTargets(displacementTexture);
+	}
+	else
+	{
+		LogWarning("Unable to decompress the hibernated displacement of: " + OwnerActor->GetName() + ". Restoring untouched snow instead.");
+	}
+
+	HibernatedDisplacement.Empty();
+
+	if (bEnableSnowPhysics)
+	{
+		InitDepthPyramid();
+	}
+}
+
+bool UInteractiveSnowComponent::IsHibernating() const
+{
+	return HibernationState != ESnowSurfaceHibernation::Awake;
+}
+
+float UInteractiveSnowComponent::GetLastActiveTime() const
+{
+	return LastActiveTime;
+}
+
+int64 UInteractiveSnowComponent::GetResidentMemory() const
+{
+	int64 size = 0;
+
+	for (UTextureRenderTarget2D* renderTarget : { RenderTarget, PrevRenderTarget })
+	{
+		if (renderTarget)
+		{
+			size += renderTarget->CalcTextureMemorySizeEnum(ETextureMipCount::TMC_ResidentMips);
+		}
+	}
+
+	if (DepthPyramid)
+	{
+		for (int32 level = 0; level < DepthPyramid->GetNumLevels(); ++level)
+		{
+			size += DepthPyramid->GetLevel(level)->CalcTextureMemorySizeEnum(ETextureMipCount::TMC_ResidentMips);
+		}
+	}
+
+	return size;
+}
+
+void UInteractiveSnowComponent::BakeInitialDisplacement()
+{
+#if WITH_EDITOR
+	// Render targets only exist while playing, so the bake reads the PIE surface and stores the result on its editor counterpart
+
+	if (!RenderTarget)
+	{
+		LogWarning("Surface is not initialized. Initial displacement can only be baked while playing in the editor.");
+		return;
+	}
+
+	if (bInfiniteSurface)
+	{
+		LogWarning("Initial displacement is not supported on infinite surfaces (the render target only covers the area around the main player).");
+		return;
+	}
+
+	// Static textures can't be created from R16f render targets, so the bake goes through an RGBA16f copy.
+	/// BC6H keeps its half float precision at 1 byte per texel. No mips since it is only copied once, at full resolution.
+
+	UTextureRenderTarget2D* floatRenderTarget = CopyDisplacementToFloatRGBA();
+
+	FString textureName = BAKED_DISPLACEMENT_DIRECTORY + OwnerActor->GetName() + NAME_SEPARATOR + GetName();
+	UTexture2D* bakedTexture = UKismetRenderingLibrary::RenderTargetCreateStaticTexture2DEditorOnly(floatRenderTarget, textureName, TextureCompressionSettings::TC_HDR_Compressed, TextureMipGenSettings::TMGS_NoMipmaps);
+
+	GetWorld()->GetSubsystem<USnowWorldSubsystem>()->ReleaseRenderTarget(floatRenderTarget);
+
+	if (!bakedTexture)
+	{
+		LogWarning("Unable to create the initial displacement texture: " + textureName);
+		return;
+	}
+
+	bakedTexture->SRGB = false;
+	bakedTexture->NeverStream = true;
+	bakedTexture->AddressX = TextureAddress::TA_Clamp;
+	bakedTexture->AddressY = TextureAddress::TA_Clamp;
+	bakedTexture->PostEditChange();
+
+	InitialDisplacement = bakedTexture;
+
+	AActor* editorActor = EditorUtilities::GetEditorWorldCounterpartActor(OwnerActor);
+	UInteractiveSnowComponent* editorComponent = editorActor ? FindObject<UInteractiveSnowComponent>(editorActor, *GetName()) : nullptr;
+
+	if (!editorComponent)
+	{
+		LogWarning("Unable to find the editor counterpart of: " + OwnerActor->GetName() + ". Assign " + bakedTexture->GetPathName() + " to its initial displacement manually.");
+		return;
+	}
+
+	editorComponent->Modify();
+	editorComponent->InitialDisplacement = bakedTexture;
+
+	UE_LOG(LogTemp, Log, TEXT("Baked initial displacement of %s to %s. Save the texture and the level to keep it."), *OwnerActor->GetName(), *bakedTexture->GetPathName());
+#else
+	LogWarning("Initial displacement can only be baked in the editor.");
+#endif
+}
+
+void UInteractiveSnowComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (SnowSubsystem)
+	{
+		SnowSubsystem->UnregisterSurface(this);
+	}
+
+	if (StaticMeshComponent)
+	{
+		StaticMeshComponent->TransformUpdated.RemoveAll(this);
+	}
+
+	CancelHibernation();
+	HibernatedDisplacement.Empty();
+	HibernationState = ESnowSurfaceHibernation::Awake;
+
+	ReleaseRenderTargets();
+
+	// Stop submissions before emptying the queue. A few racing stamps can still get in, and are dropped when drained.
+
+	bAcceptingStamps = false;
+	StampDrainSubsystem.Store(nullptr);
+	SubmittedStamps.Empty();
+
+	SnowSubsystem = nullptr;
+	bSurfaceInitialized = false;
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UInteractiveSnowComponent::OnSurfaceMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	// Bounds are already updated when the transform change is broadcast
+
+	if (SnowSubsystem)
+	{
+		SnowSubsystem->RegisterSurface(this, StaticMeshComponent);
+	}
+}
+
+bool UInteractiveSnowComponent::GetSnowDepthAtUv(FVector2D SurfaceUVs, float& OutSnowDepth) const
+{
+	OutSnowDepth = 0.f;
+
+	float depth = 0.f; // 0 = untouched snow, 1 = hole
+	FVector2D displacementUVs;
+
+	if (!bEnableSnowPhysics || !DepthPyramid || !GetDisplacementMapUvs(SurfaceUVs, displacementUVs) || !DepthPyramid->GetDepth(displacementUVs, depth))
+	{
+		return false;
+	}
+
+	OutSnowDepth = (1.f - FMath::Clamp(depth, 0.f, 1.f)) * SnowHeight;
+	return true;
 }
 
 UTextureRenderTarget2D* UInteractiveSnowComponent::CreateRenderTarget(int32 Resolution, ETextureRenderTargetFormat Format)
 {
-	UTextureRenderTarget2D* newRenderTarget = UKismetRenderingLibrary::CreateRenderTarget2D(this, Resolution, Resolution, Format);
-	newRenderTarget->AddressX = TextureAddress::TA_Clamp;
-	newRenderTarget->AddressY = TextureAddress::TA_Clamp;
-	newRenderTarget->bAutoGenerateMips = false;
+	UTextureRenderTarget2D* newRenderTarget = GetWorld()->GetSubsystem<USnowWorldSubsystem>()->AcquireRenderTarget(Resolution, Format); // Already cleared
 
-	UKismetRenderingLibrary::ClearRenderTarget2D(GetWorld(), newRenderTarget);
+	// Pooled render targets might have been used with a different address mode, which requires recreating the resource
+
+	if (newRenderTarget->AddressX != TextureAddress::TA_Clamp || newRenderTarget->AddressY != TextureAddress::TA_Clamp || newRenderTarget->bAutoGenerateMips)
+	{
+		newRenderTarget->AddressX = TextureAddress::TA_Clamp;
+		newRenderTarget->AddressY = TextureAddress::TA_Clamp;
+		newRenderTarget->bAutoGenerateMips = false;
+		newRenderTarget->UpdateResourceImmediate(true);
+	}
 
 	return newRenderTarget;
 }
 
+bool UInteractiveSnowComponent::IsSurfaceInitialized() const
+{
+	return bSurfaceInitialized;
+}
+
+void UInteractiveSnowComponent::ResetSurface()
+{
+	if (!bSurfaceInitialized || IsHibernating())
+	{
+		return;
+	}
+
+	ReleaseRenderTargets();
+	bSurfaceInitialized = false;
+}
+
 float UInteractiveSnowComponent::GetDisplacementTextureScale(float RenderSize, bool bIsInfiniteRenderSurface) const
 {
 	if (!bIsInfiniteRenderSurface)
@@ -200,6 +914,11 @@ void UInteractiveSnowComponent::InitMaterials()
 
 	StaticMeshComponent->SetMaterial(0, DynamicMaterial);
 
+	InitRenderTargetMaterials();
+}
+
+void UInteractiveSnowComponent::InitRenderTargetMaterials()
+{
 	// Create material for drawing on the render target as well
 
 	if (!RenderTargetDrawMaterial)
@@ -208,9 +927,11 @@ void UInteractiveSnowComponent::InitMaterials()
 		return;
 	}
 
+	// Unique names since the instances are created again when waking up from hibernation
+
 	FString renderTargetMaterialName = OwnerActor->GetName() + NAME_SEPARATOR + RenderTargetDrawMaterial->GetName();
-	DrawMaterialInstance = UMaterialInstanceDynamic::Create(RenderTargetDrawMaterial, this, FName(*renderTargetMaterialName));
-	DrawMaterialInstance->SetTextureParameterValue("PreviousRenderTexture", PrevRenderTarget);
+	DrawMaterialInstance = UMaterialInstanceDynamic::Create(RenderTargetDrawMaterial, this, MakeUniqueObjectName(this, UMaterialInstanceDynamic::StaticClass(), FName(*renderTargetMaterialName)));
+	DrawMaterialInstance->SetTextureParameterValue(PREVIOUS_RENDER_TEXTURE_PARAMETER_NAME, PrevRenderTarget);
 	DrawMaterialInstance->SetScalarParameterValue("UV Pixel Size", UvPixelSize);
 
 	// Create copy render texture material
@@ -222,8 +943,310 @@ void UInteractiveSnowComponent::InitMaterials()
 	}
 
 	FString copyMaterialName = OwnerActor->GetName() + NAME_SEPARATOR + RenderTargetCopyMaterial->GetName();
-	TextureCopyMaterialInstance = UMaterialInstanceDynamic::Create(RenderTargetCopyMaterial, this, FName(*copyMaterialName));
-	TextureCopyMaterialInstance->SetTextureParameterValue("TextureToCopy", RenderTarget);
+	TextureCopyMaterialInstance = UMaterialInstanceDynamic::Create(RenderTargetCopyMaterial, this, MakeUniqueObjectName(this, UMaterialInstanceDynamic::StaticClass(), FName(*copyMaterialName)));
+	TextureCopyMaterialInstance->SetTextureParameterValue(TEXTURE_TO_COPY_PARAMETER_NAME, RenderTarget);
+}
+
+void UInteractiveSnowComponent::CopyTextureToRenderTargets(UTexture* Texture)
+{
+	if (!TextureCopyMaterialInstance)
+	{
+		LogWarning("Render target copy material instance is null. Unable to copy texture to render targets.");
+		return;
+	}
+
+	// Parameter updates reach the render thread in order with the draws, so both copies read the given texture
+	/// and later cached render target copies read the render target again.
+
+	TextureCopyMaterialInstance->SetTextureParameterValue(TEXTURE_TO_COPY_PARAMETER_NAME, Texture);
+
+	UKismetRenderingLibrary::DrawMaterialToRenderTarget(GetWorld(), RenderTarget, TextureCopyMaterialInstance);
+	UKismetRenderingLibrary::DrawMaterialToRenderTarget(GetWorld(), PrevRenderTarget, TextureCopyMaterialInstance);
+
+	TextureCopyMaterialInstance->SetTextureParameterValue(TEXTURE_TO_COPY_PARAMETER_NAME, RenderTarget);
+
+	if (DepthPyramid)
+	{
+		DepthPyramid->MarkAllDirty();
+	}
+}
+
+UTextureRenderTarget2D* UInteractiveSnowComponent::CopyDisplacementToFloatRGBA()
+{
+	UTextureRenderTarget2D* floatRenderTarget = GetWorld()->GetSubsystem<USnowWorldSubsystem>()->AcquireRenderTarget(RenderTarget->SizeX, ETextureRenderTargetFormat::RTF_RGBA16f);
+
+	// Canvas gamma is 1 on float render targets, so an opaque texture draw copies the values as they are
+
+	UCanvas* canvas;
+	FVector2D canvasSize;
+	FDrawToRenderTargetContext context;
+
+	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(this, floatRenderTarget, canvas, canvasSize, context);
+	canvas->K2_DrawTexture(RenderTarget, FVector2D::ZeroVector, canvasSize, FVector2D::ZeroVector, FVector2D::UnitVector, FLinearColor::White, EBlendMode::BLEND_Opaque);
+	UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(this, context);
+
+	return floatRenderTarget;
+}
+
+void UInteractiveSnowComponent::InitDepthPyramid()
+{
+	DepthPyramid = NewObject<USnowDepthPyramid>(this);
+
+	if (!DepthPyramid->Init(RenderTarget, DepthPyramidTileSize, PhysicsReadbackLevel + 1, PhysicsUpdateInterval, bInfiniteSurface && bToroidalAddressing))
+	{
+		LogWarning("Unable to initialize depth pyramid. Render target resolution might be too low.");
+		DepthPyramid = nullptr;
+		return;
+	}
+
+	SetComponentTickEnabled(true);
+}
+
+void UInteractiveSnowComponent::InitToroidalAddressing()
+{
+	InitToroidalRenderTargets();
+
+	if (DynamicMaterial)
+	{
+		DynamicMaterial->SetScalarParameterValue(SCALE_X_PARAMETER_NAME, DisplacementTextureScale);
+		DynamicMaterial->SetScalarParameterValue(SCALE_Y_PARAMETER_NAME, DisplacementTextureScale);
+	}
+
+	// Start centered on the surface. Nothing is drawn yet so there is nothing to clear either.
+
+	float texelsPerUv = RenderTargetResolution / DisplacementTextureScale;
+	WindowOriginTexel = FIntPoint(FMath::FloorToInt(0.5f * texelsPerUv), FMath::FloorToInt(0.5f * texelsPerUv)) - FIntPoint(RenderTargetResolution / 2, RenderTargetResolution / 2);
+
+	MoveToroidalWindow(FVector2D(0.5f, 0.5f));
+}
+
+void UInteractiveSnowComponent::InitToroidalRenderTargets()
+{
+	// Render targets are addressed by surface texel modulo resolution
+
+	for (UTextureRenderTarget2D* renderTarget : { RenderTarget, PrevRenderTarget })
+	{
+		renderTarget->AddressX = TextureAddress::TA_Wrap;
+		renderTarget->AddressY = TextureAddress::TA_Wrap;
+		renderTarget->UpdateResourceImmediate(true);
+	}
+
+	if (DrawMaterialInstance)
+	{
+		// Cached texture never moves
+		DrawMaterialInstance->SetScalarParameterValue(PREV_OFFSET_X_PARAMETER_NAME, 0.f);
+		DrawMaterialInstance->SetScalarParameterValue(PREV_OFFSET_Y_PARAMETER_NAME, 0.f);
+	}
+}
+
+void UInteractiveSnowComponent::MoveToroidalWindow(FVector2D UVs)
+{
+	int32 resolution = RenderTargetResolution;
+	float texelsPerUv = resolution / DisplacementTextureScale;
+
+	FIntPoint newOrigin = FIntPoint(FMath::FloorToInt(UVs.X * texelsPerUv), FMath::FloorToInt(UVs.Y * texelsPerUv)) - FIntPoint(resolution / 2, resolution / 2);
+	FIntPoint delta = newOrigin - WindowOriginTexel;
+
+	// Clear only the rows/columns that were exposed by the move
+
+	if (delta != FIntPoint::ZeroValue)
+	{
+		TArray<FIntRect> exposedAreas;
+
+		if (FMath::Abs(delta.X) >= resolution || FMath::Abs(delta.Y) >= resolution)
+		{
+			exposedAreas.Add(FIntRect(newOrigin, newOrigin + FIntPoint(resolution, resolution)));
+		}
+		else
+		{
+			// Exposed columns over the entire new window height
+
+			if (delta.X > 0)
+			{
+				exposedAreas.Add(FIntRect(WindowOriginTexel.X + resolution, newOrigin.Y, newOrigin.X + resolution, newOrigin.Y + resolution));
+			}
+			else if (delta.X < 0)
+			{
+				exposedAreas.Add(FIntRect(newOrigin.X, newOrigin.Y, WindowOriginTexel.X, newOrigin.Y + resolution));
+			}
+
+			// Exposed rows, only where the old and new windows overlap horizontally (the rest was cleared with the columns)
+
+			int32 overlapMinX = FMath::Max(WindowOriginTexel.X, newOrigin.X);
+			int32 overlapMaxX = FMath::Min(WindowOriginTexel.X, newOrigin.X) + resolution;
+
+			if (delta.Y > 0)
+			{
+				exposedAreas.Add(FIntRect(overlapMinX, WindowOriginTexel.Y + resolution, overlapMaxX, newOrigin.Y + resolution));
+			}
+			else if (delta.Y < 0)
+			{
+				exposedAreas.Add(FIntRect(overlapMinX, newOrigin.Y, overlapMaxX, WindowOriginTexel.Y));
+			}
+		}
+
+		WindowOriginTexel = newOrigin;
+		ClearToroidalArea(exposedAreas);
+	}
+
+	// Surface material keeps masking the render area around its center, and offsets its displacement map UVs to the ring buffer address
+
+	if (DynamicMaterial)
+	{
+		FVector2D windowCenter = (FVector2D(WindowOriginTexel) + FVector2D(resolution * 0.5f, resolution * 0.5f)) / texelsPerUv;
+		FVector2D wrapOffset = windowCenter / DisplacementTextureScale - FVector2D(0.5f, 0.5f);
+
+		DynamicMaterial->SetVectorParameterValue(LOCATION_PARAMETER_NAME, FLinearColor(windowCenter.X, windowCenter.Y, 0.f, 1.f));
+		DynamicMaterial->SetVectorParameterValue(WRAP_OFFSET_PARAMETER_NAME, FLinearColor(FMath::Frac(wrapOffset.X), FMath::Frac(wrapOffset.Y), 0.f, 0.f));
+	}
+}
+
+void UInteractiveSnowComponent::DrawToroidalStamp(FVector2D UVs, FVector2D TextureScale)
+{
+	int32 resolution = RenderTargetResolution;
+	float texelsPerUv = resolution / DisplacementTextureScale;
+
+	// Texels covered by the bounding circle of the shape, clipped to the render area
+
+	FVector2D centerTexel = UVs * texelsPerUv;
+	float radius = TextureScale.Size() * 0.5f * resolution + 1.f;
+
+	FIntRect footprint = FIntRect(
+		FMath::FloorToInt(centerTexel.X - radius), FMath::FloorToInt(centerTexel.Y - radius),
+		FMath::CeilToInt(centerTexel.X + radius), FMath::CeilToInt(centerTexel.Y + radius));
+
+	footprint.Clip(FIntRect(WindowOriginTexel, WindowOriginTexel + FIntPoint(resolution, resolution)));
+
+	if (footprint.Area() <= 0)
+	{
+		return;
+	}
+
+	TArray<FIntRect> pieces;
+	SplitToroidalArea(footprint, resolution, pieces);
+
+	TArray<FIntRect> ringRects;
+
+	// Pieces on different sides of the ring buffer edges see the shape at different locations.
+	/// Material parameters can't change within a canvas batch, so each piece gets its own draw (more than one only near the edges).
+
+	for (const FIntRect& piece : pieces)
+	{
+		FIntPoint wrap = GetToroidalWrap(piece.Min, resolution);
+		FIntRect ringRect = FIntRect(piece.Min - wrap, piece.Max - wrap);
+		FVector2D location = (centerTexel - FVector2D(wrap)) / resolution;
+
+		DrawMaterialInstance->SetVectorParameterValue(LOCATION_PARAMETER_NAME, FLinearColor(location.X, location.Y, 0.f, 1.f));
+
+		UCanvas* canvas = nullptr;
+		FVector2D canvasSize;
+		FDrawToRenderTargetContext context;
+
+		UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(this, RenderTarget, canvas, canvasSize, context);
+		canvas->K2_DrawMaterial(DrawMaterialInstance, FVector2D(ringRect.Min), FVector2D(ringRect.Size()), FVector2D(ringRect.Min) / resolution, FVector2D(ringRect.Size()) / resolution);
+		UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(this, context);
+
+		ringRects.Add(ringRect);
+	}
+
+	// Cached render target only needs the same texels
+
+	UCanvas* canvas = nullptr;
+	FVector2D canvasSize;
+	FDrawToRenderTargetContext context;
+
+	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(this, PrevRenderTarget, canvas, canvasSize, context);
+
+	for (const FIntRect& ringRect : ringRects)
+	{
+		canvas->K2_DrawMaterial(TextureCopyMaterialInstance, FVector2D(ringRect.Min), FVector2D(ringRect.Size()), FVector2D(ringRect.Min) / resolution, FVector2D(ringRect.Size()) / resolution);
+
+		if (DepthPyramid)
+		{
+			DepthPyramid->MarkDirty(FVector2D(ringRect.Min) / resolution, FVector2D(ringRect.Max) / resolution);
+		}
+	}
+
+	UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(this, context);
+}
+
+void UInteractiveSnowComponent::ClearToroidalArea(const TArray<FIntRect>& TexelRects)
+{
+	int32 resolution = RenderTargetResolution;
+	TArray<FIntRect> ringRects;
+
+	for (const FIntRect& texelRect : TexelRects)
+	{
+		TArray<FIntRect> pieces;
+		SplitToroidalArea(texelRect, resolution, pieces);
+
+		for (const FIntRect& piece : pieces)
+		{
+			FIntPoint wrap = GetToroidalWrap(piece.Min, resolution);
+			ringRects.Add(FIntRect(piece.Min - wrap, piece.Max - wrap));
+		}
+	}
+
+	for (UTextureRenderTarget2D* renderTarget : { RenderTarget, PrevRenderTarget })
+	{
+		UCanvas* canvas = nullptr;
+		FVector2D canvasSize;
+		FDrawToRenderTargetContext context;
+
+		UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(this, renderTarget, canvas, canvasSize, context);
+
+		for (const FIntRect& ringRect : ringRects)
+		{
+			canvas->K2_DrawTexture(nullptr, FVector2D(ringRect.Min), FVector2D(ringRect.Size()), FVector2D::ZeroVector, FVector2D::UnitVector, FLinearColor::Black, EBlendMode::BLEND_Opaque);
+		}
+
+		UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(this, context);
+	}
+
+	if (DepthPyramid)
+	{
+		for (const FIntRect& ringRect : ringRects)
+		{
+			DepthPyramid->MarkDirty(FVector2D(ringRect.Min) / resolution, FVector2D(ringRect.Max) / resolution);
+		}
+	}
+}
+
+bool UInteractiveSnowComponent::GetDisplacementMapUvs(FVector2D SurfaceUVs, FVector2D& OutUVs) const
+{
+	if (!bInfiniteSurface)
+	{
+		OutUVs = SurfaceUVs;
+		return true;
+	}
+
+	if (bToroidalAddressing)
+	{
+		// Ring buffer address of the surface texel, as long as it is inside the current window
+
+		FVector2D texel = SurfaceUVs * (RenderTargetResolution / DisplacementTextureScale);
+		FVector2D windowTexel = texel - FVector2D(WindowOriginTexel);
+
+		OutUVs = FVector2D(FMath::Frac(texel.X / RenderTargetResolution), FMath::Frac(texel.Y / RenderTargetResolution));
+		return windowTexel.X >= 0.f && windowTexel.Y >= 0.f && windowTexel.X < RenderTargetResolution && windowTexel.Y < RenderTargetResolution;
+	}
+
+	// Main object is always in the middle of the displacement map
+	OutUVs = FVector2D(0.5f, 0.5f) + (SurfaceUVs - PrevUvLocation) * (1.f / DisplacementTextureScale);
+	return OutUVs.X >= 0.f && OutUVs.Y >= 0.f && OutUVs.X <= 1.f && OutUVs.Y <= 1.f;
+}
+
+void UInteractiveSnowComponent::MarkDepthPyramidDirty(FVector2D UVs, FVector2D TextureScale)
+{
+	if (!DepthPyramid)
+	{
+		return;
+	}
+
+	// Use the bounding circle of the shape since it can be rotated, plus one texel of margin for filtering
+
+	float halfExtent = TextureScale.Size() * 0.5f + UvPixelSize;
+	DepthPyramid->MarkDirty(UVs - FVector2D(halfExtent, halfExtent), UVs + FVector2D(halfExtent, halfExtent));
 }
 
 void UInteractiveSnowComponent::LogWarning(FString Message)
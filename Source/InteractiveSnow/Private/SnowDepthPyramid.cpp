@@ -0,0 +1,334 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+
+#include "SnowDepthPyramid.h"
+#include "Engine/Canvas.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "HAL/PlatformTime.h"
+#include "Kismet/KismetRenderingLibrary.h"
+#include "RHICommandList.h"
+#include "SnowTexelMath.h"
+#include "SnowWorldSubsystem.h"
+#include "TextureResource.h"
+
+
+bool USnowDepthPyramid::Init(UTextureRenderTarget2D* InSourceRenderTarget, int32 InTileSize, int32 NumLevels, float InReadbackInterval, bool bInWrapAddressing)
+{
+	Release();
+
+	if (!InSourceRenderTarget)
+	{
+		return false;
+	}
+
+	SourceRenderTarget = InSourceRenderTarget;
+
+	int32 sourceResolution = SourceRenderTarget->SizeX;
+	TileSize = FMath::Clamp(InTileSize, 1, sourceResolution);
+	TilesPerSide = FMath::DivideAndRoundUp(sourceResolution, TileSize);
+
+	DirtyTiles.Init(false, TilesPerSide * TilesPerSide);
+	NumDirtyTiles = 0;
+
+	// Each level is half the size of the previous one, level 0 being half the size of the source
+
+	int32 levelResolution = sourceResolution / 2;
+
+	while (levelResolution >= 1 && Levels.Num() < NumLevels)
+	{
+		// RGBA16f even though only R is used, since ReadSurfaceFloatData doesn't support other formats on every RHI (e.g. D3D11)
+
+		Levels.Add(GetWorld()->GetSubsystem<USnowWorldSubsystem>()->AcquireRenderTarget(levelResolution, ETextureRenderTargetFormat::RTF_RGBA16f));
+		levelResolution /= 2;
+	}
+
+	if (Levels.Num() == 0)
+	{
+		return false;
+	}
+
+	ReadbackLevel = Levels.Num() - 1;
+	ReadbackInterval = InReadbackInterval;
+	LastReadbackTime = 0.0;
+	bWrapAddressing = bInWrapAddressing;
+
+	CpuResolution = Levels[ReadbackLevel]->SizeX;
+	CpuDepth.Init(0.f, CpuResolution * CpuResolution);
+
+	MarkAllDirty();
+
+	return true;
+}
+
+void USnowDepthPyramid::Release()
+{
+	// Make sure the render thread is not reading back from a level that is about to be released
+	ReadbackFence.Wait();
+	PendingReadback.Reset();
+
+	USnowWorldSubsystem* snowSubsystem = GetWorld() ? GetWorld()->GetSubsystem<USnowWorldSubsystem>() : nullptr;
+
+	if (snowSubsystem)
+	{
+		for (UTextureRenderTarget2D* level : Levels)
+		{
+			snowSubsystem->ReleaseRenderTarget(level);
+		}
+	}
+
+	Levels.Empty();
+	DirtyTiles.Empty();
+	NumDirtyTiles = 0;
+
+	CpuDepth.Empty();
+	CpuResolution = 0;
+	bHasCpuData = false;
+	bReadbackDirty = false;
+
+	SourceRenderTarget = nullptr;
+}
+
+void USnowDepthPyramid::MarkDirty(FVector2D UvMin, FVector2D UvMax)
+{
+	if (Levels.Num() == 0)
+	{
+		return;
+	}
+
+	FIntRect tiles = GetTexelRect(UvMin, UvMax, TilesPerSide);
+
+	for (int32 y = tiles.Min.Y; y < tiles.Max.Y; ++y)
+	{
+		for (int32 x = tiles.Min.X; x < tiles.Max.X; ++x)
+		{
+			FBitReference tile = DirtyTiles[y * TilesPerSide + x];
+
+			if (!tile)
+			{
+				tile = true;
+				++NumDirtyTiles;
+			}
+		}
+	}
+}
+
+void USnowDepthPyramid::MarkAllDirty()
+{
+	MarkDirty(FVector2D::ZeroVector, FVector2D::UnitVector);
+}
+
+void USnowDepthPyramid::Update()
+{
+	CollectReadback();
+
+	// Nothing but the readback reads the levels, so dirty tiles are only downsampled when it is due.
+	/// Areas dirtied many times in between (e.g. every move of an "infinite" surface) are downsampled once.
+
+	bool bReadbackDue = !PendingReadback.IsValid() && FPlatformTime::Seconds() - LastReadbackTime >= ReadbackInterval;
+
+	if (!bReadbackDue || Levels.Num() == 0)
+	{
+		return;
+	}
+
+	DownsampleDirtyTiles();
+	RequestReadback();
+}
+
+void USnowDepthPyramid::DownsampleDirtyTiles()
+{
+	if (NumDirtyTiles == 0)
+	{
+		return;
+	}
+
+	for (int32 levelIndex = 0; levelIndex < Levels.Num(); ++levelIndex)
+	{
+		UTextureRenderTarget2D* level = Levels[levelIndex];
+		UTexture* previousLevel = (levelIndex == 0) ? static_cast<UTexture*>(SourceRenderTarget) : Levels[levelIndex - 1];
+		int32 levelResolution = level->SizeX;
+
+		// Coalesce the dirty tiles into tiles of the same texel size for this level, so coarse levels don't draw the same texels many times
+
+		int32 levelTilesPerSide = FMath::Clamp(levelResolution / TileSize, 1, TilesPerSide);
+		TBitArray<> levelDirtyTiles(false, levelTilesPerSide * levelTilesPerSide);
+
+		for (TConstSetBitIterator<> it(DirtyTiles); it; ++it)
+		{
+			int32 x = (it.GetIndex() % TilesPerSide) * levelTilesPerSide / TilesPerSide;
+			int32 y = (it.GetIndex() / TilesPerSide) * levelTilesPerSide / TilesPerSide;
+
+			levelDirtyTiles[y * levelTilesPerSide + x] = true;
+		}
+
+		UCanvas* canvas = nullptr;
+		FVector2D canvasSize;
+		FDrawToRenderTargetContext context;
+
+		UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(this, level, canvas, canvasSize, context);
+
+		for (TConstSetBitIterator<> it(levelDirtyTiles); it; ++it)
+		{
+			int32 x = it.GetIndex() % levelTilesPerSide;
+			int32 y = it.GetIndex() / levelTilesPerSide;
+
+			FVector2D uvMin = FVector2D(x, y) / levelTilesPerSide;
+			FVector2D uvMax = FVector2D(x + 1, y + 1) / levelTilesPerSide;
+			FIntRect texels = GetTexelRect(uvMin, uvMax, levelResolution);
+
+			FVector2D screenPosition = FVector2D(texels.Min);
+			FVector2D screenSize = FVector2D(texels.Size());
+
+			// Each texel center lands on the corner shared by 4 source texels, so bilinear filtering averages them
+			canvas->K2_DrawTexture(previousLevel, screenPosition, screenSize, screenPosition / levelResolution, screenSize / levelResolution, FLinearColor::White, EBlendMode::BLEND_Opaque);
+
+			if (levelIndex == ReadbackLevel)
+			{
+				if (bReadbackDirty)
+				{
+					ReadbackDirtyRect.Union(texels);
+				}
+				else
+				{
+					ReadbackDirtyRect = texels;
+					bReadbackDirty = true;
+				}
+			}
+		}
+
+		UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(this, context);
+	}
+
+	DirtyTiles.Init(false, TilesPerSide * TilesPerSide);
+	NumDirtyTiles = 0;
+}
+
+bool USnowDepthPyramid::HasDirtyTiles() const
+{
+	return NumDirtyTiles > 0;
+}
+
+int32 USnowDepthPyramid::GetNumLevels() const
+{
+	return Levels.Num();
+}
+
+UTextureRenderTarget2D* USnowDepthPyramid::GetLevel(int32 Level) const
+{
+	return Levels.IsValidIndex(Level) ? Levels[Level] : nullptr;
+}
+
+bool USnowDepthPyramid::GetDepth(FVector2D UVs, float& OutDepth) const
+{
+	if (!bHasCpuData)
+	{
+		return false;
+	}
+
+	float x = UVs.X * CpuResolution - 0.5f;
+	float y = UVs.Y * CpuResolution - 0.5f;
+
+	if (!bWrapAddressing)
+	{
+		x = FMath::Clamp(x, 0.f, CpuResolution - 1.f);
+		y = FMath::Clamp(y, 0.f, CpuResolution - 1.f);
+	}
+
+	int32 x0 = FMath::FloorToInt(x);
+	int32 y0 = FMath::FloorToInt(y);
+	float alphaX = x - x0;
+	float alphaY = y - y0;
+
+	// Taps past the edge wrap around on ring buffers, and stay on the edge texel otherwise
+
+	auto texel = [this](int32 X, int32 Y)
+	{
+		if (bWrapAddressing)
+		{
+			X = SnowTexelMath::PositiveModulo(X, CpuResolution);
+			Y = SnowTexelMath::PositiveModulo(Y, CpuResolution);
+		}
+		else
+		{
+			X = FMath::Min(X, CpuResolution - 1);
+			Y = FMath::Min(Y, CpuResolution - 1);
+		}
+
+		return CpuDepth[Y * CpuResolution + X];
+	};
+
+	float top = FMath::Lerp(texel(x0, y0), texel(x0 + 1, y0), alphaX);
+	float bottom = FMath::Lerp(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), alphaX);
+
+	OutDepth = FMath::Lerp(top, bottom, alphaY);
+	return true;
+}
+
+void USnowDepthPyramid::CollectReadback()
+{
+	if (!PendingReadback.IsValid() || !ReadbackFence.IsFenceComplete())
+	{
+		return;
+	}
+
+	const FIntRect& rect = PendingReadback->Rect;
+	int32 width = rect.Width();
+
+	if (PendingReadback->Data.Num() == rect.Area())
+	{
+		for (int32 y = rect.Min.Y; y < rect.Max.Y; ++y)
+		{
+			for (int32 x = rect.Min.X; x < rect.Max.X; ++x)
+			{
+				CpuDepth[y * CpuResolution + x] = PendingReadback->Data[(y - rect.Min.Y) * width + (x - rect.Min.X)].R.GetFloat();
+			}
+		}
+
+		bHasCpuData = true;
+	}
+
+	PendingReadback.Reset();
+}
+
+void USnowDepthPyramid::RequestReadback()
+{
+	// Only the area that changed since the last readback. Only one readback is in flight at a time.
+
+	if (!bReadbackDirty)
+	{
+		return;
+	}
+
+	FTextureRenderTargetResource* resource = Levels[ReadbackLevel]->GameThread_GetRenderTargetResource();
+
+	if (!resource)
+	{
+		return;
+	}
+
+	PendingReadback = MakeShared<FReadbackRequest, ESPMode::ThreadSafe>();
+	PendingReadback->Rect = ReadbackDirtyRect;
+	bReadbackDirty = false;
+	LastReadbackTime = FPlatformTime::Seconds();
+
+	TSharedPtr<FReadbackRequest, ESPMode::ThreadSafe> readback = PendingReadback;
+
+	ENQUEUE_RENDER_COMMAND(SnowDepthPyramidReadback)(
+		[resource, readback](FRHICommandListImmediate& RHICmdList)
+		{
+			RHICmdList.ReadSurfaceFloatData(resource->GetRenderTargetTexture(), readback->Rect, readback->Data, CubeFace_PosX, 0, 0);
+		});
+
+	ReadbackFence.BeginFence();
+}
+
+FIntRect USnowDepthPyramid::GetTexelRect(FVector2D UvMin, FVector2D UvMax, int32 Resolution)
+{
+	FIntPoint min = FIntPoint(FMath::FloorToInt(UvMin.X * Resolution), FMath::FloorToInt(UvMin.Y * Resolution));
+	FIntPoint max = FIntPoint(FMath::CeilToInt(UvMax.X * Resolution), FMath::CeilToInt(UvMax.Y * Resolution));
+
+	min = FIntPoint(FMath::Clamp(min.X, 0, Resolution - 1), FMath::Clamp(min.Y, 0, Resolution - 1));
+	max = FIntPoint(FMath::Clamp(max.X, min.X + 1, Resolution), FMath::Clamp(max.Y, min.Y + 1, Resolution));
+
+	return FIntRect(min, max);
+}
@@ -2,12 +2,16 @@
 
 
 #include "SnowInteractorComponent.h"
+#include "Components/StaticMeshComponent.h"
 #include "InteractiveSnowComponent.h"
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "SnowWorldSubsystem.h"
 
 
 constexpr float SCALE_FIXED_DISTANCE = 1.f; // 1 CM
+constexpr float NEIGHBOUR_TRACE_MARGIN = 1.f; // CM inside the bounds of neighbouring surfaces
+constexpr float NEIGHBOUR_HIT_REUSE_RATIO = 0.25f; // Neighbouring surfaces are traced again once the trace point moves this ratio of the hole size
 const FVector2D WORLD_FORWARD_AXIS_2D = FVector2D(1.f, 0.f);
 
 
@@ -28,6 +32,31 @@ void USnowInteractorComponent::TickComponent(float DeltaTime, ELevelTick TickTyp
 
 	UInteractiveSnowComponent* snowComponent = GetSnowComponentUnderParent(hitUVs, hit);
 
+	// Snow physics. Damping persists between ticks, so the query only needs to run at the interactor tick rate.
+
+	bool bHasSnowDepth = snowComponent && snowComponent->GetSnowDepthAtUv(hitUVs, CurrentSnowDepth);
+
+	if (!bHasSnowDepth)
+	{
+		CurrentSnowDepth = 0.f;
+	}
+
+	if (bApplySnowDrag && PhysicsBody && PhysicsBody->IsSimulatingPhysics())
+	{
+		// Without snow data (e.g. physics disabled on the surface) the body is left alone, only restoring its damping if drag was applied before
+
+		if (bHasSnowDepth)
+		{
+			PhysicsBody->SetLinearDamping(BaseLinearDamping + SnowDragCoefficient * (CurrentSnowDepth / 100.f));
+			bSnowDragApplied = true;
+		}
+		else if (bSnowDragApplied)
+		{
+			PhysicsBody->SetLinearDamping(BaseLinearDamping);
+			bSnowDragApplied = false;
+		}
+	}
+
 	if (snowComponent && currentLocation != LastLocation)
 	{
 		int32 uvChannel = snowComponent->GetUsedUvChannel();
@@ -35,7 +64,18 @@ void USnowInteractorComponent::TickComponent(float DeltaTime, ELevelTick TickTyp
 		FVector2D uvScale = GetHoleUvScale(HoleSize, hitUVs, uvChannel, hit);
 		float uvRotation = GetHoleRotation();
 
-		snowComponent->DrawMaterial(hitUVs, HoleTexture, uvScale, uvRotation, bIsActivePlayer);
+		// Submitted stamps of every surface are drawn together, once per frame, by the snow world subsystem
+
+		snowComponent->SubmitStamp(hitUVs, HoleTexture, uvScale, uvRotation, bIsActivePlayer);
+
+		if (bDrawOnNeighbourSurfaces)
+		{
+			DrawOnNeighbourSurfaces(snowComponent, hit, uvRotation);
+		}
+		else
+		{
+			NeighbourHits.Empty();
+		}
 
 		LastLocation = currentLocation;
 	}
@@ -44,6 +84,18 @@ void USnowInteractorComponent::TickComponent(float DeltaTime, ELevelTick TickTyp
 void USnowInteractorComponent::BeginPlay()
 {
 	Super::BeginPlay();
+
+	PhysicsBody = Cast<UPrimitiveComponent>(GetOwner()->GetRootComponent());
+
+	if (PhysicsBody)
+	{
+		BaseLinearDamping = PhysicsBody->GetLinearDamping();
+	}
+}
+
+float USnowInteractorComponent::GetSnowDepthUnderOwner() const
+{
+	return CurrentSnowDepth;
 }
 
 float USnowInteractorComponent::GetHoleRotation() const
@@ -136,7 +188,13 @@ UInteractiveSnowComponent* USnowInteractorComponent::GetSnowComponentUnderParent
 	params.bTraceComplex = true;
 
 	if (GetWorld()->LineTraceSingleByChannel(Hit, start, end, ECollisionChannel::ECC_Visibility, params)) {
-		foundComponent = Cast<UInteractiveSnowComponent>(Hit.Actor->GetComponentByClass(UInteractiveSnowComponent::StaticClass()));
+		foundComponent = GetWorld()->GetSubsystem<USnowWorldSubsystem>()->FindSurface(Hit.GetComponent());
+
+		// Only the primitive drawn with the snow material is registered, other primitives of the actor fall back to a component lookup
+		if (!foundComponent && Hit.GetActor())
+		{
+			foundComponent = Cast<UInteractiveSnowComponent>(Hit.GetActor()->GetComponentByClass(UInteractiveSnowComponent::StaticClass()));
+		}
 
 		int32 uvChannel = 0;
 		if (foundComponent)
@@ -150,3 +208,95 @@ UInteractiveSnowComponent* USnowInteractorComponent::GetSnowComponentUnderParent
 	return foundComponent;
 }
 
+void USnowInteractorComponent::DrawOnNeighbourSurfaces(UInteractiveSnowComponent* HitSurface, const FHitResult& Hit, float UvRotation)
+{
+	// Bounding square of the hole, since it can be rotated
+
+	float halfExtent = HoleSize * HALF_SQRT_2;
+	FVector2D center = FVector2D(Hit.Location);
+	FBox2D footprint = FBox2D(center - FVector2D(halfExtent, halfExtent), center + FVector2D(halfExtent, halfExtent));
+
+	TArray<UInteractiveSnowComponent*> surfaces;
+	GetWorld()->GetSubsystem<USnowWorldSubsystem>()->FindSurfaces(footprint, surfaces);
+
+	// Only the surfaces still overlapped keep their cached hit
+
+	TMap<TWeakObjectPtr<UInteractiveSnowComponent>, FSnowNeighbourHit> neighbourHits;
+
+	for (UInteractiveSnowComponent* surface : surfaces)
+	{
+		if (surface == HitSurface)
+		{
+			continue;
+		}
+
+		FSnowNeighbourHit neighbourHit;
+		NeighbourHits.RemoveAndCopyValue(surface, neighbourHit);
+
+		FVector2D uvs;
+
+		if (GetNeighbourSurfaceHole(surface, Hit.Location, neighbourHit, uvs))
+		{
+			surface->SubmitStamp(uvs, HoleTexture, neighbourHit.UvScale, UvRotation, bIsActivePlayer);
+			neighbourHits.Add(surface, neighbourHit);
+		}
+	}
+
+	NeighbourHits = MoveTemp(neighbourHits);
+}
+
+bool USnowInteractorComponent::GetNeighbourSurfaceHole(UInteractiveSnowComponent* Surface, FVector Location, FSnowNeighbourHit& InOutNeighbourHit, FVector2D& OutUVs) const
+{
+	UStaticMeshComponent* surfaceMesh = Surface->GetSurfaceMeshComponent();
+
+	if (!surfaceMesh)
+	{
+		return false;
+	}
+
+	// The hole center is usually outside of the neighbouring surface, so trace it at the closest point inside its bounds instead
+
+	FBox bounds = surfaceMesh->Bounds.GetBox();
+	FVector2D tracePoint = FVector2D(
+		FMath::Clamp(Location.X, bounds.Min.X + NEIGHBOUR_TRACE_MARGIN, FMath::Max(bounds.Max.X - NEIGHBOUR_TRACE_MARGIN, bounds.Min.X + NEIGHBOUR_TRACE_MARGIN)),
+		FMath::Clamp(Location.Y, bounds.Min.Y + NEIGHBOUR_TRACE_MARGIN, FMath::Max(bounds.Max.Y - NEIGHBOUR_TRACE_MARGIN, bounds.Min.Y + NEIGHBOUR_TRACE_MARGIN)));
+
+	int32 uvChannel = Surface->GetUsedUvChannel();
+
+	// Trace again only once the trace point moved away from the last hit, since the UVs are extrapolated from its triangle anyway
+
+	float reuseDistance = HoleSize * NEIGHBOUR_HIT_REUSE_RATIO;
+
+	if (!InOutNeighbourHit.bValid || FVector2D::DistSquared(tracePoint, FVector2D(InOutNeighbourHit.Hit.Location)) > reuseDistance * reuseDistance)
+	{
+		FVector start = FVector(tracePoint.X, tracePoint.Y, bounds.Max.Z + NEIGHBOUR_TRACE_MARGIN);
+		FVector end = FVector(tracePoint.X, tracePoint.Y, bounds.Min.Z - NEIGHBOUR_TRACE_MARGIN);
+
+		// Need complex trace to get UVs
+		FCollisionQueryParams params = FCollisionQueryParams::DefaultQueryParam;
+		params.bReturnFaceIndex = true;
+		params.bTraceComplex = true;
+
+		FHitResult hit;
+		FVector2D hitUVs;
+
+		if (!surfaceMesh->LineTraceComponent(hit, start, end, params) || !UGameplayStatics::FindCollisionUV(hit, uvChannel, hitUVs))
+		{
+			InOutNeighbourHit.bValid = false;
+			return false;
+		}
+
+		InOutNeighbourHit.Hit = hit;
+		InOutNeighbourHit.UvScale = GetHoleUvScale(HoleSize, hitUVs, uvChannel, hit);
+		InOutNeighbourHit.bValid = true;
+	}
+
+	// Barycentric coordinates aren't clamped to the hit triangle, so moving the hit location to the hole center extrapolates the UVs linearly
+
+	const FHitResult& hit = InOutNeighbourHit.Hit;
+
+	FHitResult centerHit = FHitResult(hit);
+	centerHit.Location = FVector::PointPlaneProject(Location, hit.Location, hit.Normal);
+
+	return UGameplayStatics::FindCollisionUV(centerHit, uvChannel, OutUVs);
+}
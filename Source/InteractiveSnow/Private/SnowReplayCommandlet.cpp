@@ -0,0 +1,169 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+
+#include "SnowReplayCommandlet.h"
+#include "Engine/Texture2D.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "SnowStampLog.h"
+#include "SnowStampReference.h"
+
+
+DEFINE_LOG_CATEGORY_STATIC(LogSnowReplay, Log, All);
+
+
+USnowReplayCommandlet::USnowReplayCommandlet(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 USnowReplayCommandlet::Main(const FString& Params)
+{
+	FString logFilename;
+
+	if (!FParse::Value(*Params, TEXT("Log="), logFilename))
+	{
+		UE_LOG(LogSnowReplay, Error, TEXT("Missing -Log=<file> parameter."));
+		return 1;
+	}
+
+	FString outputDirectory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SnowReplay"));
+	FString goldenDirectory;
+	int32 surfaceFilter = -1;
+	int32 iterations = 1;
+	float tolerance = 1.f / 255.f;
+
+	FParse::Value(*Params, TEXT("Output="), outputDirectory);
+	FParse::Value(*Params, TEXT("Golden="), goldenDirectory);
+	FParse::Value(*Params, TEXT("Surface="), surfaceFilter);
+	FParse::Value(*Params, TEXT("Iterations="), iterations);
+	FParse::Value(*Params, TEXT("Tolerance="), tolerance);
+
+	FSnowStampLog stampLog;
+
+	if (!stampLog.Load(logFilename))
+	{
+		UE_LOG(LogSnowReplay, Error, TEXT("Unable to read stamp log: %s"), *logFilename);
+		return 1;
+	}
+
+	// Load all shape textures up front so that only the stamp math is measured
+
+	TArray<FSnowShapeImage> shapes;
+	shapes.SetNum(stampLog.ShapePaths.Num());
+
+	for (int32 shapeId = 0; shapeId < stampLog.ShapePaths.Num(); ++shapeId)
+	{
+		UTexture2D* texture = LoadObject<UTexture2D>(nullptr, *stampLog.ShapePaths[shapeId]);
+
+		if (!shapes[shapeId].InitFromTextureSource(texture))
+		{
+			UE_LOG(LogSnowReplay, Warning, TEXT("Unable to read shape texture: %s. Its stamps will not draw anything."), *stampLog.ShapePaths[shapeId]);
+		}
+	}
+
+	int32 result = 0;
+
+	for (const FSnowStampLogSurface& surface : stampLog.Surfaces)
+	{
+		if (surfaceFilter >= 0 && surface.Id != surfaceFilter)
+		{
+			continue;
+		}
+
+		FSnowStampReference reference;
+		int32 numStamps = 0;
+		double startTime = FPlatformTime::Seconds();
+
+		for (int32 iteration = 0; iteration < FMath::Max(iterations, 1); ++iteration)
+		{
+			reference.Init(surface);
+
+			for (const FSnowStampLogRecord& record : stampLog.Records)
+			{
+				if (record.SurfaceId == surface.Id && shapes.IsValidIndex(record.ShapeId))
+				{
+					reference.ApplyStamp(record, shapes[record.ShapeId]);
+					++numStamps;
+				}
+			}
+		}
+
+		double elapsedTime = FPlatformTime::Seconds() - startTime;
+		double stampsPerSecond = elapsedTime > 0.0 ? numStamps / elapsedTime : 0.0;
+
+		UE_LOG(LogSnowReplay, Display, TEXT("Surface %d (%s): %d stamps at %dx%d in %.3f s (%.1f stamps/sec)"),
+			surface.Id, *surface.Name, numStamps, surface.Resolution, surface.Resolution, elapsedTime, stampsPerSecond);
+
+		// Final depth map output and golden image comparison
+
+		FString depthMapName = FString::Printf(TEXT("%s_%d.r16"), *surface.Name, surface.Id);
+
+		if (!SaveDepthMap(FPaths::Combine(outputDirectory, depthMapName), reference.GetDepth()))
+		{
+			UE_LOG(LogSnowReplay, Error, TEXT("Unable to write depth map: %s"), *depthMapName);
+			result = 1;
+		}
+
+		if (!goldenDirectory.IsEmpty() && !CompareDepthMap(FPaths::Combine(goldenDirectory, depthMapName), reference.GetDepth(), tolerance))
+		{
+			result = 1;
+		}
+	}
+
+	return result;
+}
+
+bool USnowReplayCommandlet::SaveDepthMap(const FString& Filename, const TArray<float>& Depth) const
+{
+	TArray<uint8> data;
+	data.SetNumUninitialized(Depth.Num() * static_cast<int32>(sizeof(uint16)));
+
+	uint16* texels = reinterpret_cast<uint16*>(data.GetData());
+
+	for (int32 i = 0; i < Depth.Num(); ++i)
+	{
+		texels[i] = static_cast<uint16>(FMath::RoundToInt(FMath::Clamp(Depth[i], 0.f, 1.f) * 65535.f));
+	}
+
+	return FFileHelper::SaveArrayToFile(data, *Filename);
+}
+
+bool USnowReplayCommandlet::CompareDepthMap(const FString& Filename, const TArray<float>& Depth, float Tolerance) const
+{
+	TArray<uint8> data;
+
+	if (!FFileHelper::LoadFileToArray(data, *Filename) || data.Num() != Depth.Num() * static_cast<int32>(sizeof(uint16)))
+	{
+		UE_LOG(LogSnowReplay, Error, TEXT("Golden depth map is missing or has a different size: %s"), *Filename);
+		return false;
+	}
+
+	const uint16* texels = reinterpret_cast<const uint16*>(data.GetData());
+	int32 numMismatches = 0;
+	float maxDifference = 0.f;
+
+	for (int32 i = 0; i < Depth.Num(); ++i)
+	{
+		float difference = FMath::Abs(FMath::Clamp(Depth[i], 0.f, 1.f) - texels[i] / 65535.f);
+		maxDifference = FMath::Max(maxDifference, difference);
+
+		if (difference > Tolerance)
+		{
+			++numMismatches;
+		}
+	}
+
+	if (numMismatches > 0)
+	{
+		UE_LOG(LogSnowReplay, Error, TEXT("Depth map does not match golden %s: %d texels over tolerance (max difference %.4f)"), *Filename, numMismatches, maxDifference);
+		return false;
+	}
+
+	UE_LOG(LogSnowReplay, Display, TEXT("Depth map matches golden %s (max difference %.4f)"), *Filename, maxDifference);
+	return true;
+}
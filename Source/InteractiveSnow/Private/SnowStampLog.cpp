@@ -0,0 +1,269 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+
+#include "SnowStampLog.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "Serialization/MemoryWriter.h"
+
+
+constexpr uint32 STAMP_LOG_MAGIC = 0x574F4E53; // "SNOW"
+constexpr uint32 STAMP_LOG_VERSION = 2; // 2: Toroidal addressing flag in surfaces
+constexpr uint32 STAMP_LOG_MIN_VERSION = 1;
+
+enum class ESnowStampLogEntry : uint8
+{
+	Surface = 0,
+	Shape = 1,
+	Stamp = 2
+};
+
+constexpr uint8 MAIN_PLAYER_FLAG = 1 << 0;
+
+
+void FSnowStampLogSurface::Serialize(FArchive& Ar, uint32 Version)
+{
+	Ar << Id;
+	Ar << Name;
+	Ar << Resolution;
+	Ar << bInfiniteSurface;
+	Ar << DisplacementTextureScale;
+
+	if (Version >= 2)
+	{
+		Ar << bToroidalAddressing;
+	}
+}
+
+FArchive& operator<<(FArchive& Ar, FSnowStampLogSurface& Surface)
+{
+	Surface.Serialize(Ar, STAMP_LOG_VERSION);
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FSnowStampLogRecord& Record)
+{
+	uint8 flags = Record.bIsMainPlayer ? MAIN_PLAYER_FLAG : 0;
+
+	Ar << Record.SurfaceId;
+	Ar << Record.ShapeId;
+	Ar << Record.UVs.X << Record.UVs.Y;
+	Ar << Record.TextureScale.X << Record.TextureScale.Y;
+	Ar << Record.TextureRotation;
+	Ar << flags;
+	Ar << Record.Timestamp;
+
+	Record.bIsMainPlayer = (flags & MAIN_PLAYER_FLAG) != 0;
+
+	return Ar;
+}
+
+bool FSnowStampLog::Load(const FString& Filename)
+{
+	TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*Filename));
+
+	if (!reader)
+	{
+		return false;
+	}
+
+	uint32 magic = 0;
+	uint32 version = 0;
+	*reader << magic << version;
+
+	if (magic != STAMP_LOG_MAGIC || version < STAMP_LOG_MIN_VERSION || version > STAMP_LOG_VERSION)
+	{
+		return false;
+	}
+
+	Surfaces.Empty();
+	ShapePaths.Empty();
+	Records.Empty();
+
+	// Logs of interrupted sessions (e.g. crashes) can end with a partial entry. Everything before it is kept.
+
+	int64 entriesStart = reader->Tell();
+	int64 entriesEnd = entriesStart; // End of the last complete entry
+
+	while (!reader->AtEnd())
+	{
+		uint8 entryType = 0;
+		*reader << entryType;
+
+		if (static_cast<ESnowStampLogEntry>(entryType) == ESnowStampLogEntry::Surface)
+		{
+			FSnowStampLogSurface surface;
+			surface.Serialize(*reader, version);
+
+			if (reader->IsError())
+			{
+				break;
+			}
+
+			Surfaces.Add(surface);
+			entriesEnd = reader->Tell();
+		}
+		else if (static_cast<ESnowStampLogEntry>(entryType) == ESnowStampLogEntry::Shape)
+		{
+			uint16 shapeId = 0;
+			FString shapePath;
+			*reader << shapeId << shapePath;
+
+			if (reader->IsError())
+			{
+				break;
+			}
+
+			if (ShapePaths.Num() <= shapeId)
+			{
+				ShapePaths.SetNum(shapeId + 1);
+			}
+
+			ShapePaths[shapeId] = shapePath;
+			entriesEnd = reader->Tell();
+		}
+		else if (static_cast<ESnowStampLogEntry>(entryType) == ESnowStampLogEntry::Stamp)
+		{
+			FSnowStampLogRecord record;
+			*reader << record;
+
+			if (reader->IsError())
+			{
+				break;
+			}
+
+			Records.Add(record);
+			entriesEnd = reader->Tell();
+		}
+		else
+		{
+			break; // Garbage at the end of the file
+		}
+	}
+
+	int64 fileSize = reader->TotalSize();
+
+	if (entriesEnd == entriesStart && fileSize > entriesStart)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Stamp log %s has no readable entry (%lld bytes after the header)."), *Filename, fileSize - entriesStart);
+		return false;
+	}
+
+	if (entriesEnd < fileSize)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Stamp log %s ends with a partial entry. Ignoring its last %lld bytes."), *Filename, fileSize - entriesEnd);
+	}
+
+	return true;
+}
+
+const FSnowStampLogSurface* FSnowStampLog::FindSurface(uint16 SurfaceId) const
+{
+	return Surfaces.FindByPredicate([SurfaceId](const FSnowStampLogSurface& Surface) { return Surface.Id == SurfaceId; });
+}
+
+FSnowStampLogWriter::~FSnowStampLogWriter()
+{
+	Close();
+}
+
+bool FSnowStampLogWriter::Open(const FString& InFilename)
+{
+	Close();
+
+	Writer.Reset(IFileManager::Get().CreateFileWriter(*InFilename));
+
+	if (!Writer)
+	{
+		return false;
+	}
+
+	Filename = InFilename;
+	Buffer.Reset();
+
+	uint32 magic = STAMP_LOG_MAGIC;
+	uint32 version = STAMP_LOG_VERSION;
+	*Writer << magic << version;
+
+	return true;
+}
+
+void FSnowStampLogWriter::Close()
+{
+	if (Writer)
+	{
+		// Whatever the last write task didn't get is written right away
+
+		if (PendingWrite.IsValid())
+		{
+			PendingWrite.Wait();
+			PendingWrite = TFuture<void>();
+		}
+
+		Writer->Serialize(Buffer.GetData(), Buffer.Num());
+		Buffer.Reset();
+
+		Writer->Close();
+		Writer.Reset();
+	}
+}
+
+void FSnowStampLogWriter::Flush()
+{
+	// A single write in flight keeps the entries in order. Entries buffered meanwhile wait for the next flush.
+
+	if (!Writer || Buffer.Num() == 0 || (PendingWrite.IsValid() && !PendingWrite.IsReady()))
+	{
+		return;
+	}
+
+	FArchive* fileWriter = Writer.Get();
+	TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> data = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(Buffer));
+	Buffer.Reset();
+
+	PendingWrite = Async(EAsyncExecution::ThreadPool, [fileWriter, data]()
+	{
+		fileWriter->Serialize(data->GetData(), data->Num());
+		fileWriter->Flush();
+	});
+}
+
+bool FSnowStampLogWriter::IsOpen() const
+{
+	return Writer.IsValid();
+}
+
+const FString& FSnowStampLogWriter::GetFilename() const
+{
+	return Filename;
+}
+
+void FSnowStampLogWriter::WriteSurface(FSnowStampLogSurface& Surface)
+{
+	if (Writer)
+	{
+		FMemoryWriter bufferWriter(Buffer, false, true); // Appends
+		uint8 entryType = static_cast<uint8>(ESnowStampLogEntry::Surface);
+		bufferWriter << entryType << Surface;
+	}
+}
+
+void FSnowStampLogWriter::WriteShape(uint16 ShapeId, FString& ShapePath)
+{
+	if (Writer)
+	{
+		FMemoryWriter bufferWriter(Buffer, false, true);
+		uint8 entryType = static_cast<uint8>(ESnowStampLogEntry::Shape);
+		bufferWriter << entryType << ShapeId << ShapePath;
+	}
+}
+
+void FSnowStampLogWriter::WriteRecord(FSnowStampLogRecord& Record)
+{
+	if (Writer)
+	{
+		FMemoryWriter bufferWriter(Buffer, false, true);
+		uint8 entryType = static_cast<uint8>(ESnowStampLogEntry::Stamp);
+		bufferWriter << entryType << Record;
+	}
+}
@@ -0,0 +1,287 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+
+#include "SnowStampReference.h"
+#include "Engine/Texture2D.h"
+#include "SnowStampLog.h"
+#include "SnowTexelMath.h"
+
+
+bool FSnowShapeImage::InitFromTextureSource(UTexture2D* Texture)
+{
+#if WITH_EDITORONLY_DATA
+	if (!Texture || !Texture->Source.IsValid())
+	{
+		return false;
+	}
+
+	Width = Texture->Source.GetSizeX();
+	Height = Texture->Source.GetSizeY();
+	Values.SetNumUninitialized(Width * Height);
+
+	ETextureSourceFormat format = Texture->Source.GetFormat();
+	const uint8* data = Texture->Source.LockMip(0);
+	bool bSupportedFormat = true;
+
+	for (int32 i = 0; i < Width * Height; ++i)
+	{
+		// Shapes are grayscale, so only the red channel is used
+
+		switch (format)
+		{
+			case TSF_G8:
+				Values[i] = data[i] / 255.f;
+				break;
+			case TSF_BGRA8:
+				Values[i] = data[i * 4 + 2] / 255.f;
+				break;
+			case TSF_G16:
+				Values[i] = reinterpret_cast<const uint16*>(data)[i] / 65535.f;
+				break;
+			case TSF_RGBA16:
+				Values[i] = reinterpret_cast<const uint16*>(data)[i * 4] / 65535.f;
+				break;
+			case TSF_RGBA16F:
+				Values[i] = reinterpret_cast<const FFloat16*>(data)[i * 4].GetFloat();
+				break;
+			default:
+				bSupportedFormat = false;
+				break;
+		}
+
+		if (!bSupportedFormat)
+		{
+			break;
+		}
+	}
+
+	Texture->Source.UnlockMip(0);
+
+	return bSupportedFormat;
+#else
+	return false;
+#endif
+}
+
+float FSnowShapeImage::Sample(FVector2D UVs) const
+{
+	if (Values.Num() == 0)
+	{
+		return 0.f;
+	}
+
+	float x = FMath::Clamp(UVs.X * Width - 0.5f, 0.f, Width - 1.f);
+	float y = FMath::Clamp(UVs.Y * Height - 0.5f, 0.f, Height - 1.f);
+
+	int32 x0 = FMath::FloorToInt(x);
+	int32 y0 = FMath::FloorToInt(y);
+	int32 x1 = FMath::Min(x0 + 1, Width - 1);
+	int32 y1 = FMath::Min(y0 + 1, Height - 1);
+
+	float top = FMath::Lerp(Values[y0 * Width + x0], Values[y0 * Width + x1], x - x0);
+	float bottom = FMath::Lerp(Values[y1 * Width + x0], Values[y1 * Width + x1], x - x0);
+
+	return FMath::Lerp(top, bottom, y - y0);
+}
+
+void FSnowStampReference::Init(const FSnowStampLogSurface& Surface)
+{
+	Resolution = FMath::Max(Surface.Resolution, 1);
+	bInfiniteSurface = Surface.bInfiniteSurface;
+	DisplacementTextureScale = Surface.DisplacementTextureScale;
+	UvPixelSize = 1.f / Resolution;
+	PrevUvLocation = FVector2D::ZeroVector;
+
+	Depth.Init(0.f, Resolution * Resolution);
+	ShiftedDepth.Init(0.f, Resolution * Resolution);
+
+	// Same starting window as UInteractiveSnowComponent::InitToroidalAddressing
+
+	bToroidalAddressing = Surface.bInfiniteSurface && Surface.bToroidalAddressing;
+
+	float texelsPerUv = Resolution / DisplacementTextureScale;
+	WindowOriginTexel = FIntPoint(FMath::FloorToInt(0.5f * texelsPerUv), FMath::FloorToInt(0.5f * texelsPerUv)) - FIntPoint(Resolution / 2, Resolution / 2);
+}
+
+void FSnowStampReference::ApplyStamp(const FSnowStampLogRecord& Record, const FSnowShapeImage& Shape)
+{
+	// Same as UInteractiveSnowComponent::DrawMaterial
+
+	FVector2D drawScale = Record.TextureScale;
+
+	if (!bInfiniteSurface)
+	{
+		Draw(Record.UVs, drawScale, Record.TextureRotation, FVector2D::ZeroVector, Shape);
+		return;
+	}
+
+	drawScale *= 1.f / DisplacementTextureScale;
+
+	if (bToroidalAddressing)
+	{
+		if (Record.bIsMainPlayer)
+		{
+			MoveToroidalWindow(Record.UVs);
+		}
+
+		DrawToroidal(Record.UVs, drawScale, Record.TextureRotation, Shape);
+		return;
+	}
+
+	FVector2D discreteUVs = FVector2D((FMath::FloorToFloat(Record.UVs.X / UvPixelSize) + 0.5f) * UvPixelSize, (FMath::FloorToFloat(Record.UVs.Y / UvPixelSize) + 0.5f) * UvPixelSize);
+
+	if (Record.bIsMainPlayer)
+	{
+		FVector2D distMoved = (discreteUVs - PrevUvLocation) * (1.f / DisplacementTextureScale);
+		PrevUvLocation = discreteUVs;
+
+		Draw(FVector2D(0.5f, 0.5f), drawScale, Record.TextureRotation, distMoved, Shape);
+	}
+	else
+	{
+		FVector2D uvLocation = FVector2D(0.5f, 0.5f) + (discreteUVs - PrevUvLocation) * (1.f / DisplacementTextureScale);
+
+		Draw(uvLocation, drawScale, Record.TextureRotation, FVector2D::ZeroVector, Shape);
+	}
+}
+
+int32 FSnowStampReference::GetResolution() const
+{
+	return Resolution;
+}
+
+const TArray<float>& FSnowStampReference::GetDepth() const
+{
+	return Depth;
+}
+
+void FSnowStampReference::Draw(FVector2D Location, FVector2D Scale, float Rotation, FVector2D PrevOffset, const FSnowShapeImage& Shape)
+{
+	// The draw material is a full screen pass of max(previous texture + offset, shape), followed by a copy to the previous texture.
+	// Since the shape is 0 outside of its area, only the offset requires touching every texel.
+
+	if (!PrevOffset.IsZero())
+	{
+		for (int32 y = 0; y < Resolution; ++y)
+		{
+			for (int32 x = 0; x < Resolution; ++x)
+			{
+				FVector2D uv = FVector2D(x + 0.5f, y + 0.5f) * UvPixelSize;
+				ShiftedDepth[y * Resolution + x] = SampleDepth(uv + PrevOffset);
+			}
+		}
+
+		Swap(Depth, ShiftedDepth);
+	}
+
+	float angle = Rotation * 2.f * PI;
+	float cosAngle = FMath::Cos(angle);
+	float sinAngle = FMath::Sin(angle);
+
+	// Bounding circle of the rotated shape
+
+	float radius = Scale.Size() * 0.5f;
+	int32 minX = FMath::Max(FMath::FloorToInt((Location.X - radius) * Resolution), 0);
+	int32 minY = FMath::Max(FMath::FloorToInt((Location.Y - radius) * Resolution), 0);
+	int32 maxX = FMath::Min(FMath::CeilToInt((Location.X + radius) * Resolution), Resolution);
+	int32 maxY = FMath::Min(FMath::CeilToInt((Location.Y + radius) * Resolution), Resolution);
+
+	for (int32 y = minY; y < maxY; ++y)
+	{
+		for (int32 x = minX; x < maxX; ++x)
+		{
+			FVector2D offset = FVector2D(x + 0.5f, y + 0.5f) * UvPixelSize - Location;
+
+			float& depth = Depth[y * Resolution + x];
+			depth = FMath::Max(depth, SampleShape(offset, Scale, cosAngle, sinAngle, Shape));
+		}
+	}
+}
+
+void FSnowStampReference::MoveToroidalWindow(FVector2D UVs)
+{
+	float texelsPerUv = Resolution / DisplacementTextureScale;
+	FIntPoint newOrigin = FIntPoint(FMath::FloorToInt(UVs.X * texelsPerUv), FMath::FloorToInt(UVs.Y * texelsPerUv)) - FIntPoint(Resolution / 2, Resolution / 2);
+
+	if (newOrigin == WindowOriginTexel)
+	{
+		return;
+	}
+
+	// Every ring buffer texel that is not part of both the old and new windows was exposed
+
+	FIntRect oldWindow = FIntRect(WindowOriginTexel, WindowOriginTexel + FIntPoint(Resolution, Resolution));
+
+	for (int32 y = newOrigin.Y; y < newOrigin.Y + Resolution; ++y)
+	{
+		for (int32 x = newOrigin.X; x < newOrigin.X + Resolution; ++x)
+		{
+			if (!oldWindow.Contains(FIntPoint(x, y)))
+			{
+				Depth[SnowTexelMath::PositiveModulo(y, Resolution) * Resolution + SnowTexelMath::PositiveModulo(x, Resolution)] = 0.f;
+			}
+		}
+	}
+
+	WindowOriginTexel = newOrigin;
+}
+
+void FSnowStampReference::DrawToroidal(FVector2D UVs, FVector2D Scale, float Rotation, const FSnowShapeImage& Shape)
+{
+	float texelsPerUv = Resolution / DisplacementTextureScale;
+	FVector2D centerTexel = UVs * texelsPerUv;
+	float radius = Scale.Size() * 0.5f * Resolution + 1.f;
+
+	FIntRect footprint = FIntRect(
+		FMath::FloorToInt(centerTexel.X - radius), FMath::FloorToInt(centerTexel.Y - radius),
+		FMath::CeilToInt(centerTexel.X + radius), FMath::CeilToInt(centerTexel.Y + radius));
+
+	footprint.Clip(FIntRect(WindowOriginTexel, WindowOriginTexel + FIntPoint(Resolution, Resolution)));
+
+	float angle = Rotation * 2.f * PI;
+	float cosAngle = FMath::Cos(angle);
+	float sinAngle = FMath::Sin(angle);
+
+	for (int32 y = footprint.Min.Y; y < footprint.Max.Y; ++y)
+	{
+		for (int32 x = footprint.Min.X; x < footprint.Max.X; ++x)
+		{
+			FVector2D offset = (FVector2D(x + 0.5f, y + 0.5f) - centerTexel) * UvPixelSize;
+
+			float& depth = Depth[SnowTexelMath::PositiveModulo(y, Resolution) * Resolution + SnowTexelMath::PositiveModulo(x, Resolution)];
+			depth = FMath::Max(depth, SampleShape(offset, Scale, cosAngle, sinAngle, Shape));
+		}
+	}
+}
+
+float FSnowStampReference::SampleShape(FVector2D Offset, FVector2D Scale, float CosAngle, float SinAngle, const FSnowShapeImage& Shape)
+{
+	FVector2D rotated = FVector2D(Offset.X * CosAngle + Offset.Y * SinAngle, Offset.Y * CosAngle - Offset.X * SinAngle);
+	FVector2D shapeUVs = FVector2D(rotated.X / Scale.X, rotated.Y / Scale.Y) + FVector2D(0.5f, 0.5f);
+
+	if (shapeUVs.X < 0.f || shapeUVs.X > 1.f || shapeUVs.Y < 0.f || shapeUVs.Y > 1.f)
+	{
+		return 0.f;
+	}
+
+	return Shape.Sample(shapeUVs);
+}
+
+float FSnowStampReference::SampleDepth(FVector2D UVs) const
+{
+	float x = UVs.X * Resolution - 0.5f;
+	float y = UVs.Y * Resolution - 0.5f;
+
+	int32 x0 = FMath::FloorToInt(x);
+	int32 y0 = FMath::FloorToInt(y);
+
+	auto texel = [this](int32 X, int32 Y)
+	{
+		return (X < 0 || Y < 0 || X >= Resolution || Y >= Resolution) ? 0.f : Depth[Y * Resolution + X];
+	};
+
+	float top = FMath::Lerp(texel(x0, y0), texel(x0 + 1, y0), x - x0);
+	float bottom = FMath::Lerp(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), x - x0);
+
+	return FMath::Lerp(top, bottom, y - y0);
+}
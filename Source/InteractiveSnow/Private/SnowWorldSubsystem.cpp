@@ -0,0 +1,610 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+
+#include "SnowWorldSubsystem.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Texture2D.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "InteractiveSnowComponent.h"
+#include "Kismet/KismetRenderingLibrary.h"
+#include "Misc/Paths.h"
+
+
+const FString STAMP_LOG_DIRECTORY = TEXT("SnowStamps");
+const FString STAMP_LOG_EXTENSION = TEXT(".snowlog");
+const FString SUBSYSTEM_WARNING_HEADER = TEXT("WARNING :: [Snow World Subsystem] ::");
+
+constexpr float HIBERNATION_CHECK_INTERVAL = 1.f; // Seconds between two checks of the hibernation budget
+constexpr float SURFACE_GRID_CELL_SIZE = 2000.f; // CM. Interactor footprints are much smaller, so a query usually touches 1 to 4 cells.
+
+static TAutoConsoleVariable<float> CVarSnowInitBudgetMs(
+	TEXT("snow.InitBudgetMs"),
+	2.f,
+	TEXT("Max time in milliseconds spent initializing interactive snow surfaces per frame. At least one surface is initialized per frame."));
+
+static TAutoConsoleVariable<float> CVarSnowHibernationBudgetMB(
+	TEXT("snow.HibernationBudgetMB"),
+	128.f,
+	TEXT("Video memory in megabytes that interactive snow surfaces can use before idle, off-screen surfaces start hibernating (least recently active first). 0 hibernates every idle surface."));
+
+static TAutoConsoleVariable<float> CVarSnowHibernationWakeDistance(
+	TEXT("snow.HibernationWakeDistance"),
+	3000.f,
+	TEXT("Surfaces closer than this distance (in centimeters) to a player camera never hibernate, and wake up before they are seen."));
+
+static FAutoConsoleCommandWithWorldAndArgs CmdSnowBenchmarkInit(
+	TEXT("snow.BenchmarkInit"),
+	TEXT("Initializes every awake interactive snow surface again (clearing its trails) and logs how long it takes. Arguments: 1 (default) = time-sliced, 0 = all in one frame."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (USnowWorldSubsystem* snowSubsystem = World ? World->GetSubsystem<USnowWorldSubsystem>() : nullptr)
+		{
+			snowSubsystem->RunInitBenchmark(Args.Num() == 0 || FCString::Atoi(*Args[0]) != 0);
+		}
+	}));
+
+
+static int64 GetRenderTargetPoolKey(int32 Resolution, ETextureRenderTargetFormat Format)
+{
+	return (static_cast<int64>(Resolution) << 8) | static_cast<int64>(Format);
+}
+
+// Grid cells covered by a world XY area (max exclusive)
+static FIntRect GetSurfaceGridCells(const FBox2D& Area)
+{
+	return FIntRect(
+		FMath::FloorToInt(Area.Min.X / SURFACE_GRID_CELL_SIZE), FMath::FloorToInt(Area.Min.Y / SURFACE_GRID_CELL_SIZE),
+		FMath::FloorToInt(Area.Max.X / SURFACE_GRID_CELL_SIZE) + 1, FMath::FloorToInt(Area.Max.Y / SURFACE_GRID_CELL_SIZE) + 1);
+}
+
+
+void USnowWorldSubsystem::Deinitialize()
+{
+	StopRecording();
+
+	RegisteredSurfaces.Empty();
+	SurfacesByPrimitive.Empty();
+	SurfaceGrid.Empty();
+
+	HibernatingSurfaces.Empty();
+
+	PendingSurfaceInits.Empty();
+	NextPendingSurfaceInit = 0;
+	SurfacesWithSubmittedStamps.Empty();
+	RenderTargetPool.Empty();
+
+	Super::Deinitialize();
+}
+
+void USnowWorldSubsystem::Tick(float DeltaTime)
+{
+	// Stamps submitted from any thread since the last frame
+
+	TWeakObjectPtr<UInteractiveSnowComponent> surfaceWithStamps;
+
+	while (SurfacesWithSubmittedStamps.Dequeue(surfaceWithStamps))
+	{
+		if (UInteractiveSnowComponent* surface = surfaceWithStamps.Get())
+		{
+			surface->DrawSubmittedStamps();
+		}
+	}
+
+	UpdateHibernation();
+
+	// Time-sliced surface initialization
+
+	if (NextPendingSurfaceInit < PendingSurfaceInits.Num())
+	{
+		double frameStartTime = FPlatformTime::Seconds();
+		double budget = CVarSnowInitBudgetMs.GetValueOnGameThread() / 1000.0;
+		int32 numInitialized = 0;
+
+		while (NextPendingSurfaceInit < PendingSurfaceInits.Num() && (numInitialized == 0 || FPlatformTime::Seconds() - frameStartTime < budget))
+		{
+			UInteractiveSnowComponent* surface = PendingSurfaceInits[NextPendingSurfaceInit++].Get();
+
+			// Surfaces can be initialized early by a stamp, be requested twice, or be removed while waiting
+			if (surface && surface->HasBegunPlay() && !surface->IsSurfaceInitialized())
+			{
+				surface->InitSurface();
+				++numInitialized;
+
+				if (InitFirstSurfaceTime < 0.0)
+				{
+					InitFirstSurfaceTime = FPlatformTime::Seconds() - InitStartTime;
+				}
+			}
+		}
+
+		double frameTime = FPlatformTime::Seconds() - frameStartTime;
+
+		InitMaxFrameTime = FMath::Max(InitMaxFrameTime, frameTime);
+		InitSurfaceCount += numInitialized;
+		++InitFrameCount;
+
+		if (NextPendingSurfaceInit == PendingSurfaceInits.Num())
+		{
+			PendingSurfaceInits.Empty();
+			NextPendingSurfaceInit = 0;
+
+			UE_LOG(LogTemp, Log, TEXT("Initialized %d snow surfaces over %d frames (max %.2f ms per frame). First surface ready after %.2f ms, all surfaces after %.2f ms"),
+				InitSurfaceCount, InitFrameCount, InitMaxFrameTime * 1000.0, FMath::Max(InitFirstSurfaceTime, 0.0) * 1000.0, (FPlatformTime::Seconds() - InitStartTime) * 1000.0);
+		}
+	}
+
+	// Stamps recorded during the frame go to disk on a worker thread
+
+	StampLogWriter.Flush();
+}
+
+bool USnowWorldSubsystem::IsTickable() const
+{
+	return !IsTemplate() && (NextPendingSurfaceInit < PendingSurfaceInits.Num() || RegisteredSurfaces.Num() > 0 || !SurfacesWithSubmittedStamps.IsEmpty());
+}
+
+TStatId USnowWorldSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USnowWorldSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* USnowWorldSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void USnowWorldSubsystem::RegisterSurface(UInteractiveSnowComponent* Surface, UPrimitiveComponent* SurfacePrimitive)
+{
+	if (!Surface || !SurfacePrimitive)
+	{
+		return;
+	}
+
+	UnregisterSurface(Surface);
+
+	FBox bounds = SurfacePrimitive->Bounds.GetBox();
+
+	FSnowSurfaceRegistration registration;
+	registration.SurfacePrimitive = SurfacePrimitive;
+	registration.Bounds = FBox2D(FVector2D(bounds.Min), FVector2D(bounds.Max));
+	registration.Cells = GetSurfaceGridCells(registration.Bounds);
+
+	for (int32 y = registration.Cells.Min.Y; y < registration.Cells.Max.Y; ++y)
+	{
+		for (int32 x = registration.Cells.Min.X; x < registration.Cells.Max.X; ++x)
+		{
+			SurfaceGrid.FindOrAdd(FIntPoint(x, y)).Add(Surface);
+		}
+	}
+
+	RegisteredSurfaces.Add(Surface, registration);
+	SurfacesByPrimitive.Add(SurfacePrimitive, Surface);
+}
+
+void USnowWorldSubsystem::UnregisterSurface(UInteractiveSnowComponent* Surface)
+{
+	FSnowSurfaceRegistration registration;
+
+	if (!RegisteredSurfaces.RemoveAndCopyValue(Surface, registration))
+	{
+		return;
+	}
+
+	for (int32 y = registration.Cells.Min.Y; y < registration.Cells.Max.Y; ++y)
+	{
+		for (int32 x = registration.Cells.Min.X; x < registration.Cells.Max.X; ++x)
+		{
+			FIntPoint cell = FIntPoint(x, y);
+			TArray<TWeakObjectPtr<UInteractiveSnowComponent>>* cellSurfaces = SurfaceGrid.Find(cell);
+
+			if (cellSurfaces)
+			{
+				cellSurfaces->RemoveSwap(Surface);
+
+				if (cellSurfaces->Num() == 0)
+				{
+					SurfaceGrid.Remove(cell);
+				}
+			}
+		}
+	}
+
+	SurfacesByPrimitive.Remove(registration.SurfacePrimitive);
+	HibernatingSurfaces.Remove(Surface);
+}
+
+UInteractiveSnowComponent* USnowWorldSubsystem::FindSurface(UPrimitiveComponent* SurfacePrimitive) const
+{
+	const TWeakObjectPtr<UInteractiveSnowComponent>* surface = SurfacesByPrimitive.Find(SurfacePrimitive);
+	return surface ? surface->Get() : nullptr;
+}
+
+void USnowWorldSubsystem::FindSurfaces(const FBox2D& Area, TArray<UInteractiveSnowComponent*>& OutSurfaces) const
+{
+	FIntRect cells = GetSurfaceGridCells(Area);
+
+	for (int32 y = cells.Min.Y; y < cells.Max.Y; ++y)
+	{
+		for (int32 x = cells.Min.X; x < cells.Max.X; ++x)
+		{
+			const TArray<TWeakObjectPtr<UInteractiveSnowComponent>>* cellSurfaces = SurfaceGrid.Find(FIntPoint(x, y));
+
+			if (!cellSurfaces)
+			{
+				continue;
+			}
+
+			// Cells only narrow down the candidates, the actual bounds still need to overlap
+
+			for (const TWeakObjectPtr<UInteractiveSnowComponent>& cellSurface : *cellSurfaces)
+			{
+				UInteractiveSnowComponent* surface = cellSurface.Get();
+				const FSnowSurfaceRegistration* registration = RegisteredSurfaces.Find(cellSurface);
+
+				if (surface && registration && registration->Bounds.Intersect(Area))
+				{
+					OutSurfaces.AddUnique(surface);
+				}
+			}
+		}
+	}
+}
+
+UTextureRenderTarget2D* USnowWorldSubsystem::AcquireRenderTarget(int32 Resolution, ETextureRenderTargetFormat Format)
+{
+	FSnowRenderTargetPoolBucket* bucket = RenderTargetPool.Find(GetRenderTargetPoolKey(Resolution, Format));
+
+	if (bucket && bucket->RenderTargets.Num() > 0)
+	{
+		UTextureRenderTarget2D* pooledRenderTarget = bucket->RenderTargets.Pop(false);
+		UKismetRenderingLibrary::ClearRenderTarget2D(this, pooledRenderTarget);
+
+		return pooledRenderTarget;
+	}
+
+	// Created by the subsystem so that it outlives the surface that requested it.
+	/// Address mode is set before creating the resource, so surfaces using clamp don't have to recreate it.
+
+	UTextureRenderTarget2D* newRenderTarget = NewObject<UTextureRenderTarget2D>(this);
+	newRenderTarget->RenderTargetFormat = Format;
+	newRenderTarget->ClearColor = FLinearColor::Black;
+	newRenderTarget->AddressX = TextureAddress::TA_Clamp;
+	newRenderTarget->AddressY = TextureAddress::TA_Clamp;
+	newRenderTarget->bAutoGenerateMips = false;
+	newRenderTarget->InitAutoFormat(Resolution, Resolution);
+	newRenderTarget->UpdateResourceImmediate(true);
+
+	return newRenderTarget;
+}
+
+void USnowWorldSubsystem::ReleaseRenderTarget(UTextureRenderTarget2D* RenderTarget)
+{
+	if (!RenderTarget)
+	{
+		return;
+	}
+
+	int64 key = GetRenderTargetPoolKey(RenderTarget->SizeX, RenderTarget->RenderTargetFormat);
+	RenderTargetPool.FindOrAdd(key).RenderTargets.AddUnique(RenderTarget);
+}
+
+void USnowWorldSubsystem::RequestSurfaceInit(UInteractiveSnowComponent* Surface)
+{
+	if (PendingSurfaceInits.Num() == 0)
+	{
+		InitStartTime = FPlatformTime::Seconds();
+		InitFirstSurfaceTime = -1.0;
+		InitMaxFrameTime = 0.0;
+		InitFrameCount = 0;
+		InitSurfaceCount = 0;
+	}
+
+	PendingSurfaceInits.Add(Surface);
+}
+
+void USnowWorldSubsystem::RunInitBenchmark(bool bTimeSliced)
+{
+	if (NextPendingSurfaceInit < PendingSurfaceInits.Num())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s Snow surfaces are still being initialized. Try the benchmark again later."), *SUBSYSTEM_WARNING_HEADER);
+		return;
+	}
+
+	// Hibernating surfaces are skipped, their displacement lives on the CPU instead
+
+	TArray<UInteractiveSnowComponent*> surfaces;
+
+	for (const TPair<TWeakObjectPtr<UInteractiveSnowComponent>, FSnowSurfaceRegistration>& registeredSurface : RegisteredSurfaces)
+	{
+		UInteractiveSnowComponent* surface = registeredSurface.Key.Get();
+
+		if (surface && surface->IsSurfaceInitialized() && !surface->IsHibernating())
+		{
+			surface->ResetSurface();
+			surfaces.Add(surface);
+		}
+	}
+
+	// Released render targets go back to the pool, so both runs measure pooled allocations like streaming levels would
+
+	if (bTimeSliced)
+	{
+		for (UInteractiveSnowComponent* surface : surfaces)
+		{
+			RequestSurfaceInit(surface);
+		}
+
+		return;
+	}
+
+	double startTime = FPlatformTime::Seconds();
+
+	for (UInteractiveSnowComponent* surface : surfaces)
+	{
+		surface->InitSurface();
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Initialized %d snow surfaces in a single frame: %.2f ms"), surfaces.Num(), (FPlatformTime::Seconds() - startTime) * 1000.0);
+}
+
+void USnowWorldSubsystem::QueueSubmittedStamps(UInteractiveSnowComponent* Surface)
+{
+	SurfacesWithSubmittedStamps.Enqueue(Surface);
+}
+
+int64 USnowWorldSubsystem::GetResidentSurfaceMemory() const
+{
+	int64 size = 0;
+
+	for (const TPair<TWeakObjectPtr<UInteractiveSnowComponent>, FSnowSurfaceRegistration>& registeredSurface : RegisteredSurfaces)
+	{
+		if (UInteractiveSnowComponent* surface = registeredSurface.Key.Get())
+		{
+			size += surface->GetResidentMemory();
+		}
+	}
+
+	for (const TPair<int64, FSnowRenderTargetPoolBucket>& bucket : RenderTargetPool)
+	{
+		for (UTextureRenderTarget2D* renderTarget : bucket.Value.RenderTargets)
+		{
+			size += renderTarget->CalcTextureMemorySizeEnum(ETextureMipCount::TMC_ResidentMips);
+		}
+	}
+
+	return size;
+}
+
+void USnowWorldSubsystem::UpdateHibernation()
+{
+	float currentTime = GetWorld()->GetTimeSeconds();
+	bool bCheckAwakeSurfaces = currentTime - LastHibernationCheckTime >= HIBERNATION_CHECK_INTERVAL;
+
+	// Nothing to do on most frames
+
+	if (HibernatingSurfaces.Num() == 0 && !bCheckAwakeSurfaces)
+	{
+		return;
+	}
+
+	// Surfaces near a player camera count as visible, so that they wake up before they are actually seen
+
+	TArray<FVector2D> viewLocations;
+
+	for (FConstPlayerControllerIterator iterator = GetWorld()->GetPlayerControllerIterator(); iterator; ++iterator)
+	{
+		APlayerController* playerController = iterator->Get();
+
+		if (playerController && playerController->PlayerCameraManager)
+		{
+			viewLocations.Add(FVector2D(playerController->PlayerCameraManager->GetCameraLocation()));
+		}
+	}
+
+	float wakeDistance = CVarSnowHibernationWakeDistance.GetValueOnGameThread();
+	float wakeDistanceSquared = wakeDistance * wakeDistance;
+
+	auto isNearViewer = [&viewLocations, wakeDistanceSquared](const FSnowSurfaceRegistration& Registration)
+	{
+		return viewLocations.ContainsByPredicate([&Registration, wakeDistanceSquared](const FVector2D& ViewLocation)
+		{
+			return Registration.Bounds.ComputeSquaredDistanceToPoint(ViewLocation) < wakeDistanceSquared;
+		});
+	};
+
+	// Surfaces reading back or hibernating advance every frame, so they finish and wake up without delay.
+	/// They leave the set once they are awake again, including when a stamp woke them up.
+
+	for (auto iterator = HibernatingSurfaces.CreateIterator(); iterator; ++iterator)
+	{
+		UInteractiveSnowComponent* surface = iterator->Get();
+		const FSnowSurfaceRegistration* registration = RegisteredSurfaces.Find(*iterator);
+
+		if (surface && registration)
+		{
+			surface->UpdateHibernation(currentTime, isNearViewer(*registration));
+		}
+
+		if (!surface || !registration || !surface->IsHibernating())
+		{
+			iterator.RemoveCurrent();
+		}
+	}
+
+	// Awake surfaces only need to be active recently enough to stay out of the candidates, so they are checked at the same lower rate as the budget
+
+	if (!bCheckAwakeSurfaces)
+	{
+		return;
+	}
+
+	LastHibernationCheckTime = currentTime;
+
+	for (const TPair<TWeakObjectPtr<UInteractiveSnowComponent>, FSnowSurfaceRegistration>& registeredSurface : RegisteredSurfaces)
+	{
+		UInteractiveSnowComponent* surface = registeredSurface.Key.Get();
+
+		if (surface && !HibernatingSurfaces.Contains(registeredSurface.Key))
+		{
+			surface->UpdateHibernation(currentTime, isNearViewer(registeredSurface.Value));
+		}
+	}
+
+	// Memory budget
+
+	int64 budget = static_cast<int64>(CVarSnowHibernationBudgetMB.GetValueOnGameThread() * 1024.f * 1024.f);
+	int64 residentMemory = GetResidentSurfaceMemory();
+
+	if (residentMemory <= budget)
+	{
+		return;
+	}
+
+	// Free render targets are the cheapest to give back. Hibernated surfaces return theirs to the pool, so they end up here too.
+
+	residentMemory -= TrimRenderTargetPool(residentMemory - budget);
+
+	if (residentMemory <= budget)
+	{
+		return;
+	}
+
+	TArray<UInteractiveSnowComponent*> candidates;
+
+	for (const TPair<TWeakObjectPtr<UInteractiveSnowComponent>, FSnowSurfaceRegistration>& registeredSurface : RegisteredSurfaces)
+	{
+		UInteractiveSnowComponent* surface = registeredSurface.Key.Get();
+
+		if (surface && surface->CanHibernate(currentTime))
+		{
+			candidates.Add(surface);
+		}
+	}
+
+	// Least recently active first
+
+	candidates.Sort([](const UInteractiveSnowComponent& A, const UInteractiveSnowComponent& B) { return A.GetLastActiveTime() < B.GetLastActiveTime(); });
+
+	for (UInteractiveSnowComponent* surface : candidates)
+	{
+		if (residentMemory <= budget)
+		{
+			break;
+		}
+
+		int64 surfaceMemory = surface->GetResidentMemory();
+
+		if (surface->BeginHibernation())
+		{
+			residentMemory -= surfaceMemory;
+			HibernatingSurfaces.Add(surface);
+		}
+	}
+}
+
+int64 USnowWorldSubsystem::TrimRenderTargetPool(int64 BytesToFree)
+{
+	int64 freedMemory = 0;
+
+	for (auto iterator = RenderTargetPool.CreateIterator(); iterator && freedMemory < BytesToFree; ++iterator)
+	{
+		TArray<UTextureRenderTarget2D*>& renderTargets = iterator->Value.RenderTargets;
+
+		while (renderTargets.Num() > 0 && freedMemory < BytesToFree)
+		{
+			UTextureRenderTarget2D* renderTarget = renderTargets.Pop(false);
+			freedMemory += renderTarget->CalcTextureMemorySizeEnum(ETextureMipCount::TMC_ResidentMips);
+
+			// Out of the pool, the object has no owner left. Marked so that the next garbage collection reclaims it even if a stale reference remains.
+			renderTarget->ReleaseResource();
+			renderTarget->MarkPendingKill();
+		}
+
+		if (renderTargets.Num() == 0)
+		{
+			iterator.RemoveCurrent();
+		}
+	}
+
+	return freedMemory;
+}
+
+bool USnowWorldSubsystem::StartRecording(FString Filename)
+{
+	StopRecording();
+
+	if (Filename.IsEmpty())
+	{
+		FString logName = GetWorld()->GetMapName() + TEXT("_") + FDateTime::Now().ToString() + STAMP_LOG_EXTENSION;
+		Filename = FPaths::Combine(FPaths::ProjectSavedDir(), STAMP_LOG_DIRECTORY, logName);
+	}
+
+	if (!StampLogWriter.Open(Filename))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s Unable to create stamp log: %s"), *SUBSYSTEM_WARNING_HEADER, *Filename);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Recording snow stamps to: %s"), *Filename);
+	return true;
+}
+
+void USnowWorldSubsystem::StopRecording()
+{
+	StampLogWriter.Close();
+	RecordedSurfaceIds.Empty();
+	RecordedShapeIds.Empty();
+}
+
+bool USnowWorldSubsystem::IsRecording() const
+{
+	return StampLogWriter.IsOpen();
+}
+
+void USnowWorldSubsystem::RecordStamp(UInteractiveSnowComponent* Surface, FVector2D UVs, UTexture2D* ShapeTexture, FVector2D TextureScale, float TextureRotation, bool bIsMainPlayer)
+{
+	if (!IsRecording() && !StartRecording(FString()))
+	{
+		return;
+	}
+
+	// Surfaces and shapes are written the first time they are used
+
+	uint16* surfaceId = RecordedSurfaceIds.Find(Surface);
+
+	if (!surfaceId)
+	{
+		FSnowStampLogSurface surface;
+		Surface->GetStampLogSurface(surface);
+		surface.Id = static_cast<uint16>(RecordedSurfaceIds.Num());
+
+		StampLogWriter.WriteSurface(surface);
+		surfaceId = &RecordedSurfaceIds.Add(Surface, surface.Id);
+	}
+
+	uint16* shapeId = RecordedShapeIds.Find(ShapeTexture);
+
+	if (!shapeId)
+	{
+		FString shapePath = ShapeTexture ? ShapeTexture->GetPathName() : FString();
+		uint16 newShapeId = static_cast<uint16>(RecordedShapeIds.Num());
+
+		StampLogWriter.WriteShape(newShapeId, shapePath);
+		shapeId = &RecordedShapeIds.Add(ShapeTexture, newShapeId);
+	}
+
+	FSnowStampLogRecord record;
+	record.SurfaceId = *surfaceId;
+	record.ShapeId = *shapeId;
+	record.UVs = UVs;
+	record.TextureScale = TextureScale;
+	record.TextureRotation = TextureRotation;
+	record.bIsMainPlayer = bIsMainPlayer;
+	record.Timestamp = GetWorld()->GetTimeSeconds();
+
+	StampLogWriter.WriteRecord(record);
+}
@@ -0,0 +1,141 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+
+#include "Async/Async.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "InteractiveSnowComponent.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/Paths.h"
+#include "SnowStampLog.h"
+#include "SnowWorldSubsystem.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+
+constexpr int32 SUBMISSION_TEST_NUM_TASKS = 8;
+constexpr int32 SUBMISSION_TEST_STAMPS_PER_TASK = 256;
+constexpr int32 SUBMISSION_TEST_STAMPS_PER_BURST = 16; // Producers yield between bursts so that they overlap with several drains
+
+const TCHAR* SUBMISSION_TEST_SURFACE_MESH = TEXT("/Engine/BasicShapes/Plane.Plane");
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSnowStampSubmissionTest, "InteractiveSnow.StampSubmission.ConcurrentProducers",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FSnowStampSubmissionTest::RunTest(const FString& Parameters)
+{
+	// Game world that is never ticked, the snow world subsystem is ticked by hand instead
+
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	worldContext.SetCurrentWorld(world);
+
+	USnowWorldSubsystem* snowSubsystem = world->GetSubsystem<USnowWorldSubsystem>();
+
+	// Surface actor, set up before it begins play. Stamps are recorded so that the drawn order can be checked.
+
+	AActor* surfaceActor = world->SpawnActor<AActor>();
+
+	UStaticMeshComponent* surfaceMesh = NewObject<UStaticMeshComponent>(surfaceActor);
+	surfaceMesh->SetMobility(EComponentMobility::Movable);
+	surfaceMesh->SetStaticMesh(LoadObject<UStaticMesh>(nullptr, SUBMISSION_TEST_SURFACE_MESH));
+	surfaceActor->SetRootComponent(surfaceMesh);
+	surfaceMesh->RegisterComponent();
+
+	UInteractiveSnowComponent* surface = NewObject<UInteractiveSnowComponent>(surfaceActor);
+	FindFProperty<FBoolProperty>(UInteractiveSnowComponent::StaticClass(), TEXT("bRecordStamps"))->SetPropertyValue_InContainer(surface, true);
+	surface->RegisterComponent();
+
+	surfaceActor->DispatchBeginPlay();
+
+	FString logFilename = FPaths::Combine(FPaths::AutomationTransientDir(), TEXT("SnowStampSubmissionTest.snowlog"));
+	TestTrue(TEXT("Stamp log created"), snowSubsystem->StartRecording(logFilename));
+
+	// Producers run on task graph workers while the game thread keeps ticking the subsystem. UVs identify the task and the stamp index within it.
+
+	TArray<TFuture<void>> producers;
+
+	for (int32 taskIndex = 0; taskIndex < SUBMISSION_TEST_NUM_TASKS; ++taskIndex)
+	{
+		producers.Add(Async(EAsyncExecution::TaskGraph, [surface, taskIndex]()
+		{
+			for (int32 i = 0; i < SUBMISSION_TEST_STAMPS_PER_TASK; ++i)
+			{
+				surface->SubmitStamp(FVector2D(taskIndex, i), nullptr, FVector2D::UnitVector, 0.f);
+
+				if ((i + 1) % SUBMISSION_TEST_STAMPS_PER_BURST == 0)
+				{
+					FPlatformProcess::Sleep(0.f);
+				}
+			}
+		}));
+	}
+
+	int32 numConcurrentDrains = 0;
+	bool bProducersRunning = true;
+
+	while (bProducersRunning)
+	{
+		bProducersRunning = producers.ContainsByPredicate([](const TFuture<void>& Producer) { return !Producer.IsReady(); });
+
+		int64 numDrainedBefore = surface->GetNumDrainedStamps();
+		snowSubsystem->Tick(0.f);
+
+		if (bProducersRunning && surface->GetNumDrainedStamps() > numDrainedBefore)
+		{
+			++numConcurrentDrains;
+		}
+	}
+
+	// Stamps submitted right before the producers finished are drained on the next frame
+
+	snowSubsystem->Tick(0.f);
+	snowSubsystem->StopRecording();
+
+	int64 numStamps = static_cast<int64>(SUBMISSION_TEST_NUM_TASKS) * SUBMISSION_TEST_STAMPS_PER_TASK;
+
+	TestEqual(TEXT("Submitted stamp count"), surface->GetNumSubmittedStamps(), numStamps);
+	TestEqual(TEXT("Drained stamp count"), surface->GetNumDrainedStamps(), numStamps);
+	TestTrue(TEXT("Stamps drained while producers were submitting"), numConcurrentDrains > 0);
+
+	// No stamp is lost or duplicated, and stamps of the same task are drawn in submission order
+
+	FSnowStampLog stampLog;
+
+	if (TestTrue(TEXT("Stamp log loaded"), stampLog.Load(logFilename)))
+	{
+		TestEqual(TEXT("Recorded stamp count"), static_cast<int64>(stampLog.Records.Num()), numStamps);
+
+		TArray<int32> nextStampOfTask;
+		nextStampOfTask.SetNumZeroed(SUBMISSION_TEST_NUM_TASKS);
+
+		for (const FSnowStampLogRecord& record : stampLog.Records)
+		{
+			int32 taskIndex = FMath::RoundToInt(record.UVs.X);
+			int32 stampIndex = FMath::RoundToInt(record.UVs.Y);
+
+			if (!TestTrue(TEXT("Valid task index"), nextStampOfTask.IsValidIndex(taskIndex)) ||
+				!TestEqual(TEXT("Stamp index within its task"), stampIndex, nextStampOfTask[taskIndex]))
+			{
+				break;
+			}
+
+			++nextStampOfTask[taskIndex];
+		}
+	}
+
+	IFileManager::Get().Delete(*logFilename);
+
+	surfaceActor->Destroy();
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+
+	return true;
+}
+
+#endif
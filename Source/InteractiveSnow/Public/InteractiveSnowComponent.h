@@ -3,11 +3,42 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
 #include "Components/ActorComponent.h"
+#include "Containers/Queue.h"
 #include "Engine/TextureRenderTarget2D.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter64.h"
+#include "RenderCommandFence.h"
+#include "Templates/Atomic.h"
 #include "InteractiveSnowComponent.generated.h"
 
 
+class USceneComponent;
+class USnowDepthPyramid;
+class USnowWorldSubsystem;
+struct FSnowStampLogSurface;
+
+
+// DrawMaterial call submitted from any thread, waiting to be drawn on the game thread
+struct FSnowSubmittedStamp
+{
+	FVector2D UVs = FVector2D::ZeroVector;
+	TWeakObjectPtr<UTexture2D> ShapeTexture;
+	FVector2D TextureScale = FVector2D::UnitVector;
+	float TextureRotation = 0.f;
+	bool bIsMainPlayer = false;
+};
+
+// Hibernation state of a surface. Hibernating surfaces keep their displacement compressed in system memory instead of in render targets.
+enum class ESnowSurfaceHibernation : uint8
+{
+	Awake,
+	ReadingBack, // Displacement is being read back and compressed. Render targets are still valid.
+	Hibernating
+};
+
+
 // This component enables the interaction with snow surfaces. It requires a static mesh component to be present on the actor.
 // NOTE: Requires 0-1 UVs in UV0, UV1 or UV2
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
@@ -18,6 +49,8 @@ class INTERACTIVESNOW_API UInteractiveSnowComponent : public UActorComponent
 public:	
 	UInteractiveSnowComponent(const FObjectInitializer& ObjectInitializer);
 
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
 	/**
 	* Draws the given shape in this surface using the UV location, texture, and texture scale.
 	* When it is an infinite surface, it requires an additional parameter that indicates the main player/object.
@@ -31,6 +64,34 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void DrawMaterial(FVector2D UVs, UTexture2D* ShapeTexture, FVector2D TextureScale, float TextureRotation, bool bIsMainPlayer = false);
 
+	/**
+	* Thread-safe version of DrawMaterial. The stamp is queued and drawn on the game thread by the snow world subsystem, at the end of the frame.
+	* Can be called from any thread (e.g. physics callbacks or async tasks). Stamps submitted before BeginPlay are drawn once the surface begins play,
+	* stamps submitted after EndPlay are dropped. Callers on other threads must not outlive the world of the surface.
+	*
+	* @param UVs - UV location of the hole
+	* @param ShapeTexture - Texture to use when drawing
+	* @param TextureScale - Scale value to apply when drawing on the texture
+	* @param TextureRotation - Rotation value to apply when drawing on the texture (0-1 matches 0-360 rotation)
+	* @param bIsMainPlayer - Indicates whether this is the main player/object or not (only relevant when it is set as infinite)
+	*/
+	void SubmitStamp(FVector2D UVs, UTexture2D* ShapeTexture, FVector2D TextureScale, float TextureRotation, bool bIsMainPlayer = false);
+
+	/**
+	* Draws all the stamps submitted with SubmitStamp so far. Game thread only. Called by the snow world subsystem.
+	*/
+	void DrawSubmittedStamps();
+
+	/**
+	* Returns the total number of stamps submitted with SubmitStamp (from any thread)
+	*/
+	int64 GetNumSubmittedStamps() const;
+
+	/**
+	* Returns the total number of submitted stamps that have been taken out of the queue and drawn
+	*/
+	int64 GetNumDrainedStamps() const;
+
 	/**
 	* Returns the used UV channel for this snow component
 	*
@@ -39,6 +100,102 @@ public:
 	UFUNCTION(BlueprintCallable)
 	int32 GetUsedUvChannel() const;
 
+	/**
+	* Returns the static mesh component drawn with the snow material (null if the owner actor doesn't have one)
+	*/
+	UFUNCTION(BlueprintCallable)
+	UStaticMeshComponent* GetSurfaceMeshComponent() const;
+
+	/**
+	* Creates the render targets and materials of this surface. Called by the snow world subsystem when initialization is time-sliced,
+	* or directly during BeginPlay (or on the first stamp) otherwise.
+	*/
+	void InitSurface();
+
+	/**
+	* Returns whether the render targets and materials of this surface are ready or not
+	*/
+	UFUNCTION(BlueprintCallable)
+	bool IsSurfaceInitialized() const;
+
+	/**
+	* Releases the render targets and materials of an initialized, awake surface so that it can be initialized again. Its trails are lost.
+	*/
+	void ResetSurface();
+
+	/**
+	* Gets the height of the snow left at the given location, using the CPU copy of the depth pyramid (updated on a throttled schedule).
+	*
+	* @param SurfaceUVs - UV location on the surface (same UV channel used for drawing)
+	* @param OutSnowDepth - Stores the snow height in centimeters in this reference (0 when no data is available)
+	*
+	* @return False when snow physics is disabled, the surface is hibernating or no readback has completed yet
+	*/
+	UFUNCTION(BlueprintCallable)
+	bool GetSnowDepthAtUv(FVector2D SurfaceUVs, float& OutSnowDepth) const;
+
+	/**
+	* Updates the activity of the surface and advances its hibernation. Wakes up hibernating surfaces that became visible.
+	* Called by the snow world subsystem every frame while hibernating, and at a lower rate while awake.
+	*
+	* @param CurrentTime - World time in seconds
+	* @param bNearViewer - Whether a player camera is close enough to see the surface soon
+	*/
+	void UpdateHibernation(float CurrentTime, bool bNearViewer);
+
+	/**
+	* Returns whether the surface has been idle (no stamps) and off-screen for long enough to hibernate
+	*
+	* @param CurrentTime - World time in seconds
+	*/
+	bool CanHibernate(float CurrentTime) const;
+
+	/**
+	* Starts reading back the displacement so that the render targets and materials can be released once it is compressed.
+	* Any stamp cancels the hibernation or wakes the surface up again.
+	*
+	* @return False when the surface can't hibernate right now
+	*/
+	bool BeginHibernation();
+
+	/**
+	* Restores the render targets and materials of a hibernating surface from its compressed displacement
+	*/
+	void WakeUp();
+
+	/**
+	* Returns whether the render targets of this surface are released (or about to be)
+	*/
+	UFUNCTION(BlueprintCallable)
+	bool IsHibernating() const;
+
+	/**
+	* Returns the world time of the last stamp, or of the last frame the surface was visible
+	*/
+	float GetLastActiveTime() const;
+
+	/**
+	* Returns the video memory used by the render targets of this surface (including the depth pyramid)
+	*
+	* @return Size in bytes
+	*/
+	int64 GetResidentMemory() const;
+
+	/**
+	* Fills the surface description used by stamp logs (everything needed to replay this surface's stamps offline)
+	*
+	* @param OutSurface - Stores the surface description in this reference
+	*/
+	void GetStampLogSurface(FSnowStampLogSurface& OutSurface) const;
+
+	/**
+	* Captures the current displacement of this surface to a compressed texture asset (in /Game/Textures/BakedSnow) and assigns it
+	* as the initial displacement of the surface in the editor world, so levels can start with authored trails.
+	* NOTE: Editor only. Needs to be called while playing in the editor (e.g. from the details panel of the PIE surface).
+	*/
+	UFUNCTION(BlueprintCallable, CallInEditor)
+	void BakeInitialDisplacement();
+
 protected:
 	UPROPERTY()
 	AActor* OwnerActor = nullptr;
@@ -64,6 +221,59 @@ protected:
 	UPROPERTY()
 	UTextureRenderTarget2D* RenderTarget = nullptr;
 
+	UPROPERTY()
+	USnowDepthPyramid* DepthPyramid = nullptr;
+
+	UPROPERTY()
+	bool bSurfaceInitialized = false;
+
+	UPROPERTY()
+	USnowWorldSubsystem* SnowSubsystem = nullptr; // Game thread only
+
+	// Subsystem that drains submitted stamps, read by the submitting threads. Null before BeginPlay and after EndPlay.
+	TAtomic<USnowWorldSubsystem*> StampDrainSubsystem { nullptr };
+
+	// Cleared on EndPlay. Nothing drains the queue of a surface that ended play, so later submissions are dropped.
+	FThreadSafeBool bAcceptingStamps = true;
+
+	// Stamps submitted from any thread (multiple producers), drained on the game thread (single consumer)
+	TQueue<FSnowSubmittedStamp, EQueueMode::Mpsc> SubmittedStamps;
+
+	// Set when the surface is queued for draining in the subsystem, so that it is only queued once per frame
+	FThreadSafeBool bSubmittedStampsQueued = false;
+
+	FThreadSafeCounter64 NumSubmittedStamps;
+	int64 NumDrainedStamps = 0;
+
+
+	// --- HIBERNATION PROPERTIES --- //
+
+	UPROPERTY()
+	float LastActiveTime = 0.f;
+
+	// World time of the last UpdateHibernation call, so that the visibility check covers the whole time since then
+	float LastVisibilityCheckTime = 0.f;
+
+	ESnowSurfaceHibernation HibernationState = ESnowSurfaceHibernation::Awake;
+
+	// R channel of the displacement map (half floats), zlib compressed
+	TArray<uint8> HibernatedDisplacement;
+
+	struct FHibernationReadback
+	{
+		TArray<FFloat16Color> Data;
+		TArray<uint8> CompressedData;
+	};
+
+	TSharedPtr<FHibernationReadback, ESPMode::ThreadSafe> PendingHibernation;
+	FRenderCommandFence HibernationFence;
+
+	// RGBA16f copy of the displacement being read back (R16f surfaces can't be read as floats). Returned to the pool once the readback is done.
+	UPROPERTY()
+	UTextureRenderTarget2D* HibernationReadbackTarget = nullptr;
+
+	TFuture<bool> HibernationCompression;
+
 
 	// --- INFINITE SURFACE PROPERTIES --- //
 
@@ -76,6 +286,9 @@ protected:
 	UPROPERTY()
 	FVector2D PrevUvLocation = FVector2D::ZeroVector; // Used for "infinite" surfaces only.
 
+	UPROPERTY()
+	FIntPoint WindowOriginTexel = FIntPoint::ZeroValue; // Surface texel at the corner of the render area. Used for toroidal addressing only.
+
 
 	// --- EXPOSED PROPERTIES --- //
 
@@ -87,6 +300,12 @@ protected:
 	UPROPERTY(EditAnywhere)
 	float InfiniteSurfaceRenderArea = 2000.f;
 
+	// Uses the render target as a wrap-addressed ring buffer on "infinite" surfaces. Moving the render area only clears the newly exposed texels
+	// instead of resampling the entire texture. NOTE: Requires the surface material to add a "Wrap Offset" vector parameter to the displacement map UVs,
+	// otherwise it is disabled on begin play (the included surface material doesn't have it).
+	UPROPERTY(EditAnywhere)
+	bool bToroidalAddressing = false;
+
 	// Base material to use for the surface/object
 	UPROPERTY(EditAnywhere)
 	UMaterialInterface* BaseMaterial = nullptr;
@@ -102,22 +321,75 @@ protected:
 	UPROPERTY(EditAnywhere)
 	int32 RenderTargetResolution = 1024;
 
+	// Displacement copied to the render targets when the surface is initialized, instead of starting untouched. Created with BakeInitialDisplacement.
+	// NOTE: Not supported on "infinite" surfaces.
+	UPROPERTY(EditAnywhere)
+	UTexture2D* InitialDisplacement = nullptr;
+
 	// UV channel to use for the snow displacement
 	UPROPERTY(EditAnywhere)
 	int32 UvChannel = 0;
 
+	// Spreads the initialization of surfaces across frames (see snow.InitBudgetMs) to avoid hitches when many surfaces begin play at once.
+	// A surface that receives a stamp before being initialized is initialized right away. Off by default, so surfaces are ready on BeginPlay.
+	UPROPERTY(EditAnywhere)
+	bool bTimeSlicedInit = false;
+
+	// Lets the surface release its render targets when it is idle and off-screen, and the snow memory budget (snow.HibernationBudgetMB) is exceeded.
+	// The displacement is kept compressed in system memory and restored on the next stamp or when the surface becomes visible.
+	UPROPERTY(EditAnywhere)
+	bool bAllowHibernation = true;
+
+	// Seconds without stamps and off-screen before the surface can hibernate
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0", UIMax = "300"))
+	float HibernationDelay = 30.f;
+
+	// Records every DrawMaterial call on this surface to a stamp log (Saved/SnowStamps), so it can be replayed with the SnowReplay commandlet
+	UPROPERTY(EditAnywhere)
+	bool bRecordStamps = false;
+
+
+	// --- SNOW PHYSICS PROPERTIES --- //
+
+	// Reads back a low resolution copy of the displacement (depth pyramid) so that interactors can sink and slow down in deep snow.
+	UPROPERTY(EditAnywhere)
+	bool bEnableSnowPhysics = false;
+
+	// Height of untouched snow in centimeters. Should match the displacement height of the surface material.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0", UIMax = "200"))
+	float SnowHeight = 30.f;
+
+	// Depth pyramid level read back for physics queries (0 = half resolution). Lower levels are more precise but slower to read back.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0"))
+	int32 PhysicsReadbackLevel = 2;
+
+	// Min time in seconds between two physics readbacks. Only the areas that changed are downsampled and read back.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0", UIMax = "2"))
+	float PhysicsUpdateInterval = 0.2f;
+
+	// Size in texels of the tiles that are tracked as dirty. Smaller tiles mean less wasted texels but more draw calls.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "8", UIMax = "256"))
+	int32 DepthPyramidTileSize = 64;
+
 
 	// --- FUNCTIONS / METHODS --- //
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/**
+	* Updates the bounds of this surface in the snow world subsystem registry when its mesh moves
+	*/
+	void OnSurfaceMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
 	/**
-	* Creates and initializes a new render target texture of the given resolution and format
+	* Gets a render target of the given resolution and format from the world pool and initializes it
 	*
 	* @param Resolution - Pixel resolution in X and Y
 	* @param Format - Format to use for this render target
 	*
-	* @return New initialized render target
+	* @return Initialized render target
 	*/
 	UFUNCTION(BlueprintCallable)
 	UTextureRenderTarget2D* CreateRenderTarget(int32 Resolution, ETextureRenderTargetFormat Format);
@@ -150,6 +422,95 @@ protected:
 	UFUNCTION(BlueprintCallable)
 	void InitMaterials();
 
+	/**
+	* Creates the material instances used when drawing and copying render targets
+	*/
+	void InitRenderTargetMaterials();
+
+	/**
+	* Releases the render targets (back to the pool), the depth pyramid, and the render target material instances
+	*/
+	void ReleaseRenderTargets();
+
+	/**
+	* Moves the compressed displacement out of the finished readback and releases the render targets
+	*/
+	void FinishHibernation();
+
+	void CancelHibernation();
+
+	void ReleaseHibernationReadbackTarget();
+
+	/**
+	* Overwrites both render targets with the given texture, using the copy material
+	*
+	* @param Texture - Texture to copy (same resolution as the render targets)
+	*/
+	void CopyTextureToRenderTargets(UTexture* Texture);
+
+	/**
+	* Copies the displacement render target into an RGBA16f one. It is the only float format that CPU readbacks and static texture creation accept.
+	*
+	* @return Render target from the pool (R = displacement). Must be returned with ReleaseRenderTarget.
+	*/
+	UTextureRenderTarget2D* CopyDisplacementToFloatRGBA();
+
+	/**
+	* Creates the depth pyramid of the displacement render target, down to the physics readback level
+	*/
+	UFUNCTION(BlueprintCallable)
+	void InitDepthPyramid();
+
+	/**
+	* Sets up the render targets and materials for toroidal addressing (wrap addressing, no cached texture offset)
+	*/
+	void InitToroidalAddressing();
+
+	/**
+	* Switches both render targets to wrap addressing and removes the cached texture offset of the draw material
+	*/
+	void InitToroidalRenderTargets();
+
+	/**
+	* Moves the toroidal render area so that it is centered on the given location, and clears the texels that it exposes
+	*
+	* @param UVs - Location of the main player/object on the surface
+	*/
+	void MoveToroidalWindow(FVector2D UVs);
+
+	/**
+	* Draws the shape on the toroidal render targets, touching only the texels covered by the shape inside the render area
+	*
+	* @param UVs - Location of the shape on the surface
+	* @param TextureScale - Scale of the shape in displacement map UV space
+	*/
+	void DrawToroidalStamp(FVector2D UVs, FVector2D TextureScale);
+
+	/**
+	* Clears the given surface texel area of both render targets
+	*
+	* @param TexelRects - Areas to clear in surface texels (must be inside the current render area)
+	*/
+	void ClearToroidalArea(const TArray<FIntRect>& TexelRects);
+
+	/**
+	* Converts surface UVs to displacement map UVs (only different on infinite surfaces)
+	*
+	* @param SurfaceUVs - UV location on the surface
+	* @param OutUVs - Stores the UV location on the displacement map
+	*
+	* @return False when the location is outside of the displacement area
+	*/
+	bool GetDisplacementMapUvs(FVector2D SurfaceUVs, FVector2D& OutUVs) const;
+
+	/**
+	* Marks the area covered by a drawn shape as dirty in the depth pyramid
+	*
+	* @param UVs - Location of the shape in displacement map UV space
+	* @param TextureScale - Scale of the shape in displacement map UV space
+	*/
+	void MarkDepthPyramidDirty(FVector2D UVs, FVector2D TextureScale);
+
 	/**
 	* Logs a warning using a preset header + the given message.
 	*
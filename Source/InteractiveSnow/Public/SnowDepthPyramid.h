@@ -0,0 +1,138 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "RenderCommandFence.h"
+#include "SnowDepthPyramid.generated.h"
+
+
+class UTextureRenderTarget2D;
+
+
+// Mip pyramid of a displacement render target, each level holding the average depth of the previous one (R).
+// Its coarsest level is read back to the CPU on a throttled schedule, so that gameplay and physics code can do cheap depth queries.
+// Only the tiles that were marked as dirty since the last readback are downsampled again, right before the next readback is requested.
+UCLASS()
+class INTERACTIVESNOW_API USnowDepthPyramid : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	* Creates the render targets of every pyramid level.
+	*
+	* @param InSourceRenderTarget - Full resolution displacement render target (single channel)
+	* @param InTileSize - Size of a dirty tile in texels of the source render target
+	* @param NumLevels - Number of levels (0 = half of the source resolution). The last one is read back to the CPU. Stops earlier at 1x1.
+	* @param InReadbackInterval - Min time in seconds between two readbacks
+	* @param bInWrapAddressing - Whether the source is a wrap-addressed ring buffer (toroidal addressing), so that depth lookups wrap around its edges
+	*
+	* @return Whether the pyramid could be initialized or not
+	*/
+	bool Init(UTextureRenderTarget2D* InSourceRenderTarget, int32 InTileSize, int32 NumLevels, float InReadbackInterval = 0.f, bool bInWrapAddressing = false);
+
+	/**
+	* Releases all the render targets of this pyramid
+	*/
+	void Release();
+
+	/**
+	* Marks all tiles overlapping the given area as dirty so that they are downsampled on the next update.
+	*
+	* @param UvMin - Top left corner of the area in displacement map UV space
+	* @param UvMax - Bottom right corner of the area in displacement map UV space
+	*/
+	void MarkDirty(FVector2D UvMin, FVector2D UvMax);
+
+	/**
+	* Marks the entire pyramid as dirty
+	*/
+	void MarkAllDirty();
+
+	/**
+	* Collects the CPU readback if it is ready. When the next readback is due, downsamples all dirty tiles through the chain and requests it.
+	*/
+	void Update();
+
+	/**
+	* Returns whether there are tiles waiting to be downsampled
+	*/
+	bool HasDirtyTiles() const;
+
+	int32 GetNumLevels() const;
+
+	/**
+	* Returns the render target of the given level (0 = half of the source resolution)
+	*/
+	UTextureRenderTarget2D* GetLevel(int32 Level) const;
+
+	/**
+	* Gets the approximate depth at the given location (bilinear) using the CPU copy of the readback level.
+	*
+	* @param UVs - Location in displacement map UV space (wrapped when using wrap addressing, clamped otherwise)
+	* @param OutDepth - Stores the depth at the given location
+	*
+	* @return False when there is no CPU data available yet
+	*/
+	bool GetDepth(FVector2D UVs, float& OutDepth) const;
+
+protected:
+	UPROPERTY()
+	UTextureRenderTarget2D* SourceRenderTarget = nullptr;
+
+	UPROPERTY()
+	TArray<UTextureRenderTarget2D*> Levels;
+
+	// Dirty tiles, in tiles of the source render target
+	TBitArray<> DirtyTiles;
+
+	int32 TileSize = 64;
+	int32 TilesPerSide = 1;
+	int32 NumDirtyTiles = 0;
+
+	// CPU copy of the readback level
+	TArray<float> CpuDepth;
+	int32 CpuResolution = 0;
+	bool bHasCpuData = false;
+
+	bool bWrapAddressing = false;
+
+	int32 ReadbackLevel = 0;
+	float ReadbackInterval = 0.f;
+	double LastReadbackTime = 0.0;
+
+	// Area of the readback level that changed since the last readback was requested
+	FIntRect ReadbackDirtyRect;
+	bool bReadbackDirty = false;
+
+	struct FReadbackRequest
+	{
+		FIntRect Rect;
+		TArray<FFloat16Color> Data;
+	};
+
+	TSharedPtr<FReadbackRequest, ESPMode::ThreadSafe> PendingReadback;
+	FRenderCommandFence ReadbackFence;
+
+	/**
+	* Downsamples the dirty tiles through every level, and adds the texels they cover in the readback level to the readback dirty area
+	*/
+	void DownsampleDirtyTiles();
+
+	/**
+	* Copies the finished readback (if any) to the CPU data
+	*/
+	void CollectReadback();
+
+	/**
+	* Requests a new readback for the dirty area of the readback level
+	*/
+	void RequestReadback();
+
+	/**
+	* Converts an UV area to the texel area that fully contains it in a texture of the given resolution
+	*/
+	static FIntRect GetTexelRect(FVector2D UvMin, FVector2D UvMax, int32 Resolution);
+};
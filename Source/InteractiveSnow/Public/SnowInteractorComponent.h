@@ -11,6 +11,15 @@ class Texture2D;
 class UInteractiveSnowComponent;
 
 
+// Last trace on a neighbouring surface, reused while the hole stays close to it
+struct FSnowNeighbourHit
+{
+	FHitResult Hit;
+	FVector2D UvScale = FVector2D::UnitVector; // Hole UV scale at the hit
+	bool bValid = false;
+};
+
+
 // Component that makes an actor interact with a snow surface/component
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
 class INTERACTIVESNOW_API USnowInteractorComponent : public UActorComponent
@@ -22,10 +31,35 @@ public:
 
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+	/**
+	* Returns the height of the snow under the owner actor, as of the last tick. Only drag is applied by this component,
+	* sinking (e.g. offsetting a mesh or capsule by this height) is left to gameplay code.
+	* Requires the snow surface to have snow physics enabled.
+	*
+	* @return Snow height in centimeters (0 when not on a snow surface or when no snow data is available)
+	*/
+	UFUNCTION(BlueprintCallable)
+	float GetSnowDepthUnderOwner() const;
+
 protected:
 	UPROPERTY()
 	FVector LastLocation = FVector::ZeroVector;
 
+	UPROPERTY()
+	float CurrentSnowDepth = 0.f;
+
+	UPROPERTY()
+	UPrimitiveComponent* PhysicsBody = nullptr;
+
+	UPROPERTY()
+	float BaseLinearDamping = 0.f;
+
+	UPROPERTY()
+	bool bSnowDragApplied = false;
+
+	// Neighbouring surfaces overlapped by the last hole
+	TMap<TWeakObjectPtr<UInteractiveSnowComponent>, FSnowNeighbourHit> NeighbourHits;
+
 
 	// --- EXPOSED PROPERTIES --- //
 
@@ -48,6 +82,18 @@ protected:
 	UPROPERTY(EditAnywhere)
 	UTexture2D* HoleTexture;
 
+	// Also draws the hole on neighbouring surfaces that its footprint overlaps (e.g. when standing on the seam between two surfaces)
+	UPROPERTY(EditAnywhere)
+	bool bDrawOnNeighbourSurfaces = true;
+
+	// Slows down the owner actor's simulated root body according to the snow under it. Requires snow physics on the surface.
+	UPROPERTY(EditAnywhere)
+	bool bApplySnowDrag = false;
+
+	// Linear damping added to the simulated root body per meter of snow under it
+	UPROPERTY(EditAnywhere, meta = (UIMin = "0", UIMax = "20"))
+	float SnowDragCoefficient = 5.f;
+
 
 	// --- FUNCTIONS / METHODS --- //
 
@@ -84,4 +130,26 @@ protected:
 	*/
 	UFUNCTION(BlueprintCallable)
 	UInteractiveSnowComponent* GetSnowComponentUnderParent(FVector2D& OutUVs, FHitResult& Hit) const;
+
+	/**
+	* Submits the hole to all the registered surfaces (other than the hit one) whose bounds overlap the hole footprint.
+	* Drawn in the same batch as the stamp on the hit surface.
+	*
+	* @param HitSurface - Surface under the owner actor, already drawn to
+	* @param Hit - Collision hit information of the hit surface
+	* @param UvRotation - Rotation value used when drawing on the hit surface
+	*/
+	void DrawOnNeighbourSurfaces(UInteractiveSnowComponent* HitSurface, const FHitResult& Hit, float UvRotation);
+
+	/**
+	* Gets the UV location and scale of a hole centered outside of (or at the edge of) the given surface
+	*
+	* @param Surface - Neighbouring surface
+	* @param Location - World location of the hole center
+	* @param InOutNeighbourHit - Last trace on the surface. Traced again (and updated) when it is invalid or too far away. Holds the UV scale of the hole.
+	* @param OutUVs - Stores the UV location of the hole center on the surface (can be outside of 0-1)
+	*
+	* @return False when the surface couldn't be traced near the given location
+	*/
+	bool GetNeighbourSurfaceHole(UInteractiveSnowComponent* Surface, FVector Location, FSnowNeighbourHit& InOutNeighbourHit, FVector2D& OutUVs) const;
 };
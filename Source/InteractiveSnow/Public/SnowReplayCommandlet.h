@@ -0,0 +1,46 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SnowReplayCommandlet.generated.h"
+
+
+// Replays a stamp log against the CPU reference of the stamp drawing, as fast as possible.
+// Reports stamps/sec and writes the final depth map of every surface as a 16-bit .r16 heightmap.
+//
+// Usage: -run=SnowReplay -Log=<file> [-Surface=<id>] [-Output=<dir>] [-Golden=<dir>] [-Tolerance=<0-1>] [-Iterations=<n>]
+// When a golden directory is given, the depth maps are compared against the files with the same name and the commandlet fails on mismatch.
+UCLASS()
+class INTERACTIVESNOW_API USnowReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USnowReplayCommandlet(const FObjectInitializer& ObjectInitializer);
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+	/**
+	* Writes the depth map as a 16-bit unsigned heightmap
+	*
+	* @param Filename - Path of the output file
+	* @param Depth - Depth values (0-1)
+	*
+	* @return Whether the file could be written or not
+	*/
+	bool SaveDepthMap(const FString& Filename, const TArray<float>& Depth) const;
+
+	/**
+	* Compares the depth map against a golden 16-bit heightmap
+	*
+	* @param Filename - Path of the golden file
+	* @param Depth - Depth values (0-1)
+	* @param Tolerance - Max allowed difference per texel (0-1)
+	*
+	* @return Whether all texels are within tolerance or not
+	*/
+	bool CompareDepthMap(const FString& Filename, const TArray<float>& Depth, float Tolerance) const;
+};
@@ -0,0 +1,111 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+
+
+// Surface description stored in a stamp log. Contains everything needed to replay the stamps of a surface without the game.
+struct INTERACTIVESNOW_API FSnowStampLogSurface
+{
+	uint16 Id = 0;
+	FString Name;
+	int32 Resolution = 0;
+	bool bInfiniteSurface = false;
+	float DisplacementTextureScale = 1.f;
+	bool bToroidalAddressing = false; // Added in version 2
+
+	/**
+	* Serializes the surface as stored by the given log version
+	*
+	* @param Ar - Archive to read from / write to
+	* @param Version - Version of the log. Fields that didn't exist yet keep their defaults when loading.
+	*/
+	void Serialize(FArchive& Ar, uint32 Version);
+
+	friend FArchive& operator<<(FArchive& Ar, FSnowStampLogSurface& Surface);
+};
+
+// Single DrawMaterial call stored in a stamp log
+struct INTERACTIVESNOW_API FSnowStampLogRecord
+{
+	uint16 SurfaceId = 0;
+	uint16 ShapeId = 0;
+	FVector2D UVs = FVector2D::ZeroVector;
+	FVector2D TextureScale = FVector2D::UnitVector;
+	float TextureRotation = 0.f;
+	bool bIsMainPlayer = false;
+	float Timestamp = 0.f; // World time in seconds
+
+	friend FArchive& operator<<(FArchive& Ar, FSnowStampLogRecord& Record);
+};
+
+// Compact binary log of DrawMaterial calls, used to reproduce and benchmark interaction streams offline.
+// The file is a header followed by a stream of tagged entries. Surfaces and shape textures are written the first time they are used,
+// so the log stays valid even if the recording is interrupted.
+class INTERACTIVESNOW_API FSnowStampLog
+{
+public:
+	TArray<FSnowStampLogSurface> Surfaces;
+	TArray<FString> ShapePaths; // Indexed by shape ID
+	TArray<FSnowStampLogRecord> Records;
+
+	/**
+	* Loads an entire stamp log from disk. A partial entry at the end of the file (e.g. after a crash) is ignored.
+	*
+	* @param Filename - Path of the log file
+	*
+	* @return False when the file can't be opened, isn't a stamp log of a supported version, or has no readable entry
+	*/
+	bool Load(const FString& Filename);
+
+	/**
+	* Returns the surface with the given ID, or null if it is not part of the log
+	*/
+	const FSnowStampLogSurface* FindSurface(uint16 SurfaceId) const;
+};
+
+// Streams stamp log entries to disk while the game is running. Entries are buffered in memory and written by a worker thread on Flush
+// (once per frame), so recording doesn't add file IO to the game thread.
+class INTERACTIVESNOW_API FSnowStampLogWriter
+{
+public:
+	~FSnowStampLogWriter();
+
+	/**
+	* Creates the log file and writes the header
+	*
+	* @param Filename - Path of the log file
+	*
+	* @return Whether the file could be created or not
+	*/
+	bool Open(const FString& Filename);
+
+	/**
+	* Waits for the write in flight, writes the remaining entries and closes the file
+	*/
+	void Close();
+
+	/**
+	* Hands the buffered entries to a worker thread that appends them to the file. Skipped while the previous write is still in flight.
+	*/
+	void Flush();
+
+	bool IsOpen() const;
+
+	const FString& GetFilename() const;
+
+	void WriteSurface(FSnowStampLogSurface& Surface);
+
+	void WriteShape(uint16 ShapeId, FString& ShapePath);
+
+	void WriteRecord(FSnowStampLogRecord& Record);
+
+private:
+	TUniquePtr<FArchive> Writer;
+	FString Filename;
+
+	TArray<uint8> Buffer; // Entries waiting for the next flush
+	TFuture<void> PendingWrite;
+};
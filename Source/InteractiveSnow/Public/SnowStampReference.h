@@ -0,0 +1,100 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+class UTexture2D;
+struct FSnowStampLogRecord;
+struct FSnowStampLogSurface;
+
+
+// Grayscale shape texture in CPU memory (0 = no hole, 1 = hole)
+struct INTERACTIVESNOW_API FSnowShapeImage
+{
+	int32 Width = 0;
+	int32 Height = 0;
+	TArray<float> Values;
+
+	/**
+	* Reads the source data of the given texture. Only available in editor builds since it needs the texture source data.
+	*
+	* @param Texture - Shape texture to read
+	*
+	* @return Whether the texture could be read or not
+	*/
+	bool InitFromTextureSource(UTexture2D* Texture);
+
+	/**
+	* Bilinear sample with clamped addressing
+	*
+	* @param UVs - UV location to sample
+	*
+	* @return Sampled value
+	*/
+	float Sample(FVector2D UVs) const;
+};
+
+// CPU reference of the displacement map drawing done by the component and the render target draw material (M_DepthPainter).
+// Used to replay stamp logs offline, so it has to mirror UInteractiveSnowComponent::DrawMaterial.
+class INTERACTIVESNOW_API FSnowStampReference
+{
+public:
+	/**
+	* Resets the depth map and the infinite surface state using the recorded surface settings
+	*
+	* @param Surface - Surface settings as recorded in the stamp log
+	*/
+	void Init(const FSnowStampLogSurface& Surface);
+
+	/**
+	* Draws a recorded stamp on the depth map
+	*
+	* @param Record - Recorded DrawMaterial call
+	* @param Shape - Shape texture data of the stamp
+	*/
+	void ApplyStamp(const FSnowStampLogRecord& Record, const FSnowShapeImage& Shape);
+
+	int32 GetResolution() const;
+
+	const TArray<float>& GetDepth() const;
+
+private:
+	int32 Resolution = 0;
+	bool bInfiniteSurface = false;
+	float DisplacementTextureScale = 1.f;
+	float UvPixelSize = 1.f;
+	FVector2D PrevUvLocation = FVector2D::ZeroVector;
+
+	bool bToroidalAddressing = false;
+	FIntPoint WindowOriginTexel = FIntPoint::ZeroValue;
+
+	TArray<float> Depth;
+	TArray<float> ShiftedDepth; // Scratch buffer used when the cached texture is moved
+
+	/**
+	* Draws the shape over the previous depth map (optionally offset) and stores the result in the depth map
+	*/
+	void Draw(FVector2D Location, FVector2D Scale, float Rotation, FVector2D PrevOffset, const FSnowShapeImage& Shape);
+
+	/**
+	* Toroidal addressing: moves the render area so that it is centered on the given location, and clears the texels that it exposes
+	*/
+	void MoveToroidalWindow(FVector2D UVs);
+
+	/**
+	* Toroidal addressing: draws the shape on the texels it covers inside the render area, addressed by surface texel modulo resolution
+	*/
+	void DrawToroidal(FVector2D UVs, FVector2D Scale, float Rotation, const FSnowShapeImage& Shape);
+
+	/**
+	* Returns the shape value at the given offset from the shape center (in displacement map UV space)
+	*/
+	static float SampleShape(FVector2D Offset, FVector2D Scale, float CosAngle, float SinAngle, const FSnowShapeImage& Shape);
+
+	/**
+	* Bilinear sample of the depth map. Outside of the 0-1 range is treated as untouched snow.
+	*/
+	float SampleDepth(FVector2D UVs) const;
+};
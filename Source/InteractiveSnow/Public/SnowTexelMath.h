@@ -0,0 +1,22 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+// Integer helpers for texel coordinates of ring buffers (toroidal addressing), which can be negative
+namespace SnowTexelMath
+{
+	// Floor division that also works for negative texel coordinates
+	FORCEINLINE int32 FloorDivide(int32 Value, int32 Divisor)
+	{
+		return (Value >= 0) ? Value / Divisor : -((-Value + Divisor - 1) / Divisor);
+	}
+
+	// Modulo that always returns a value in [0, Divisor)
+	FORCEINLINE int32 PositiveModulo(int32 Value, int32 Divisor)
+	{
+		return Value - FloorDivide(Value, Divisor) * Divisor;
+	}
+}
@@ -0,0 +1,207 @@
+// Originally made by Jose Ivan Lopez Romo (https://www.ivanlopezr.com)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Tickable.h"
+#include "SnowStampLog.h"
+#include "SnowWorldSubsystem.generated.h"
+
+
+class UInteractiveSnowComponent;
+class UPrimitiveComponent;
+class UTexture2D;
+
+
+// Free render targets of a single resolution/format
+USTRUCT()
+struct FSnowRenderTargetPoolBucket
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<UTextureRenderTarget2D*> RenderTargets;
+};
+
+
+// Registered snow surface. Bounds are captured on registration, surfaces register again when their mesh moves.
+struct FSnowSurfaceRegistration
+{
+	TWeakObjectPtr<UPrimitiveComponent> SurfacePrimitive;
+	FBox2D Bounds = FBox2D(ForceInit); // World XY
+	FIntRect Cells; // Surface grid cells covered by the bounds (max exclusive)
+};
+
+
+// World-level state shared by all the interactive snow surfaces of a world.
+// Handles the surface registry, the render target pool, the time-sliced initialization of surfaces, the hibernation of idle surfaces,
+// and the recording of stamp logs.
+UCLASS()
+class INTERACTIVESNOW_API USnowWorldSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+
+	/**
+	* Adds a surface to the registry so that interactors can find it by the primitive they hit, or by area.
+	* Registering an already registered surface updates its bounds (surfaces do it themselves when their mesh moves).
+	*
+	* @param Surface - Surface to register
+	* @param SurfacePrimitive - Primitive component that is drawn with the snow material
+	*/
+	void RegisterSurface(UInteractiveSnowComponent* Surface, UPrimitiveComponent* SurfacePrimitive);
+
+	void UnregisterSurface(UInteractiveSnowComponent* Surface);
+
+	/**
+	* Returns the surface drawn by the given primitive component (e.g. the component of a hit result), or null if it is not a snow surface
+	*/
+	UInteractiveSnowComponent* FindSurface(UPrimitiveComponent* SurfacePrimitive) const;
+
+	/**
+	* Gets all the surfaces whose bounds overlap the given area, using the surface grid
+	*
+	* @param Area - World XY area
+	* @param OutSurfaces - Stores the overlapping surfaces in this reference
+	*/
+	void FindSurfaces(const FBox2D& Area, TArray<UInteractiveSnowComponent*>& OutSurfaces) const;
+
+	/**
+	* Gets a cleared render target from the pool, or creates a new one if there is none of the given resolution and format.
+	*
+	* @param Resolution - Pixel resolution in X and Y
+	* @param Format - Format of the render target
+	*
+	* @return Render target owned by the pool. Must be returned with ReleaseRenderTarget.
+	*/
+	UTextureRenderTarget2D* AcquireRenderTarget(int32 Resolution, ETextureRenderTargetFormat Format);
+
+	/**
+	* Returns a render target to the pool so that other surfaces can reuse it (e.g. when streaming levels in and out)
+	*
+	* @param RenderTarget - Render target previously acquired from the pool
+	*/
+	void ReleaseRenderTarget(UTextureRenderTarget2D* RenderTarget);
+
+	/**
+	* Queues the initialization of a surface. Queued surfaces are initialized over several frames, within a per-frame time budget (snow.InitBudgetMs).
+	*
+	* @param Surface - Surface to initialize
+	*/
+	void RequestSurfaceInit(UInteractiveSnowComponent* Surface);
+
+	/**
+	* Initializes all the awake surfaces again (their trails are cleared) and logs the time it takes. Used by the snow.BenchmarkInit console command.
+	*
+	* @param bTimeSliced - Whether to go through the time-sliced initialization, or initialize every surface in a single frame
+	*/
+	void RunInitBenchmark(bool bTimeSliced);
+
+	/**
+	* Queues a surface whose submitted stamps have to be drawn at the end of the frame. Thread-safe.
+	*
+	* @param Surface - Surface with submitted stamps
+	*/
+	void QueueSubmittedStamps(UInteractiveSnowComponent* Surface);
+
+	/**
+	* Returns the video memory used by the render targets of all the awake surfaces, plus the free ones kept in the pool
+	*
+	* @return Size in bytes
+	*/
+	int64 GetResidentSurfaceMemory() const;
+
+	/**
+	* Starts recording all stamps of the surfaces that have stamp recording enabled.
+	*
+	* @param Filename - Path of the log file. When empty, a new file is created in Saved/SnowStamps.
+	*
+	* @return Whether the log file could be created or not
+	*/
+	UFUNCTION(BlueprintCallable)
+	bool StartRecording(FString Filename);
+
+	/**
+	* Stops recording and closes the log file
+	*/
+	UFUNCTION(BlueprintCallable)
+	void StopRecording();
+
+	UFUNCTION(BlueprintCallable)
+	bool IsRecording() const;
+
+	/**
+	* Writes a DrawMaterial call to the stamp log. Starts recording automatically if it isn't already.
+	*
+	* @param Surface - Surface that received the stamp
+	* @param UVs - UV location of the stamp
+	* @param ShapeTexture - Texture used when drawing
+	* @param TextureScale - Scale value applied when drawing
+	* @param TextureRotation - Rotation value applied when drawing (0-1)
+	* @param bIsMainPlayer - Whether it was drawn by the main player/object
+	*/
+	void RecordStamp(UInteractiveSnowComponent* Surface, FVector2D UVs, UTexture2D* ShapeTexture, FVector2D TextureScale, float TextureRotation, bool bIsMainPlayer);
+
+protected:
+	TMap<TWeakObjectPtr<UInteractiveSnowComponent>, FSnowSurfaceRegistration> RegisteredSurfaces;
+	TMap<TWeakObjectPtr<UPrimitiveComponent>, TWeakObjectPtr<UInteractiveSnowComponent>> SurfacesByPrimitive;
+
+	// Spatial hash of the surface bounds. Each cell lists the surfaces that overlap it.
+	TMap<FIntPoint, TArray<TWeakObjectPtr<UInteractiveSnowComponent>>> SurfaceGrid;
+
+	// Free render targets, keyed by resolution and format
+	UPROPERTY()
+	TMap<int64, FSnowRenderTargetPoolBucket> RenderTargetPool;
+
+	// Surfaces reading back their displacement or hibernating, updated every frame (awake ones only every hibernation check)
+	TSet<TWeakObjectPtr<UInteractiveSnowComponent>> HibernatingSurfaces;
+
+	// Surfaces waiting for their time-sliced initialization. Consumed from NextPendingSurfaceInit and emptied once all are done.
+	TArray<TWeakObjectPtr<UInteractiveSnowComponent>> PendingSurfaceInits;
+	int32 NextPendingSurfaceInit = 0;
+
+	/**
+	* Advances the hibernation of hibernating surfaces every frame, and checks the activity of the awake ones at a lower rate. While over the memory budget, frees the pooled render targets first,
+	* then hibernates the least recently active idle surfaces (their render targets are freed on the next check).
+	*/
+	void UpdateHibernation();
+
+	/**
+	* Removes free render targets from the pool and releases them until enough memory is freed or the pool is empty
+	*
+	* @param BytesToFree - Memory to free in bytes
+	*
+	* @return Memory actually freed in bytes
+	*/
+	int64 TrimRenderTargetPool(int64 BytesToFree);
+
+	// Surfaces with stamps submitted from any thread, drained on the game thread every frame
+	TQueue<TWeakObjectPtr<UInteractiveSnowComponent>, EQueueMode::Mpsc> SurfacesWithSubmittedStamps;
+
+	// World time of the last check of the hibernation budget
+	float LastHibernationCheckTime = 0.f;
+
+	// Initialization benchmark, measured from the time the first surface is queued
+	double InitStartTime = 0.0;
+	double InitFirstSurfaceTime = -1.0; // Until the first surface is initialized (usable by interactors)
+	double InitMaxFrameTime = 0.0;
+	int32 InitFrameCount = 0;
+	int32 InitSurfaceCount = 0;
+
+	FSnowStampLogWriter StampLogWriter;
+
+	// IDs of the surfaces and shapes already written to the current log
+	TMap<TWeakObjectPtr<UInteractiveSnowComponent>, uint16> RecordedSurfaceIds;
+	TMap<TWeakObjectPtr<UTexture2D>, uint16> RecordedShapeIds;
+};